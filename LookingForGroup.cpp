@@ -4,332 +4,6893 @@
 #include <condition_variable> 
 #include <vector> 
 #include <queue> 
+#include <deque> 
 #include <atomic> 
 #include <random> 
 #include <chrono> 
 #include <string> 
+#include <string_view>
+#include <utility>
 #include <iomanip> 
 #include <algorithm> 
+#include <numeric> 
 #include <sstream>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <bit>
+#include <cstdint>
+#include <unordered_map>
+#include <map>
+#include <functional>
+#include <span>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <cerrno>
+#include <limits>
+#include <new>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LFG_HAVE_MMAP 1
+#define LFG_HAVE_POSIX_IO 1
+#endif
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#define LFG_HAVE_EPOLL 1
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define LFG_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef LFG_COUNT_ALLOCATIONS
+// Heap allocations made by the calling thread, counted by the replacement operator new family 
+// below so --selftest can check that the matching path stops allocating once warmed up. Opt-in 
+// (build with -DLFG_COUNT_ALLOCATIONS) so normal builds keep the library allocator. 
+inline thread_local uint64_t threadAllocations = 0; 
+
+inline void* countedAllocate(std::size_t size, std::size_t alignment) noexcept {
+    threadAllocations++; 
+    size = size == 0 ? 1 : size; 
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment); 
+#else
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+inline void countedFree(void* memory, std::size_t alignment) noexcept {
+#ifdef _WIN32
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(memory); 
+        return;
+    }
+#endif
+    (void)alignment; 
+    std::free(memory);
+}
+
+inline void* countedAllocateOrThrow(std::size_t size, std::size_t alignment) {
+    if (void* memory = countedAllocate(size, alignment)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+// Out of line so GCC does not pair the inlined free() with new expressions and warn 
+[[gnu::noinline]] void* operator new(std::size_t size) {
+    return countedAllocateOrThrow(size, 0);
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size) {
+    return countedAllocateOrThrow(size, 0);
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void operator delete(void* memory) noexcept {
+    countedFree(memory, 0);
+}
+
+[[gnu::noinline]] void operator delete[](void* memory) noexcept {
+    countedFree(memory, 0);
+}
+
+[[gnu::noinline]] void operator delete(void* memory, std::size_t) noexcept {
+    countedFree(memory, 0);
+}
+
+[[gnu::noinline]] void operator delete[](void* memory, std::size_t) noexcept {
+    countedFree(memory, 0);
+}
+
+[[gnu::noinline]] void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    countedFree(memory, 0);
+}
+
+[[gnu::noinline]] void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    countedFree(memory, 0);
+}
+
+[[gnu::noinline]] void operator delete(void* memory, std::align_val_t alignment) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void operator delete[](void* memory, std::align_val_t alignment) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void operator delete[](void* memory, std::size_t, std::align_val_t alignment) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    countedFree(memory, static_cast<std::size_t>(alignment));
+}
+#endif
+
+// Player roles 
+enum Role { Tank = 0, Healer = 1, DPS = 2, RoleCount = 3 };
+
+inline constexpr const char* roleNames[RoleCount] = {"Tanks", "Healers", "DPS"};
+inline constexpr const char* roleName[RoleCount] = {"Tank", "Healer", "DPS"};
+
+// Queue priority tiers, lowest first 
+enum Tier { Standard = 0, Premium = 1, Returning = 2, TierCount = 3 };
+
+inline constexpr const char* tierNames[TierCount] = {"Standard", "Premium", "Returning"};
+
+// Instances one system can hold, autoscaled ones included; the state file has a slot for each 
+inline constexpr int MaxInstanceCount = 1024; 
+
+// Sets of acceptable roles for flex players 
+inline constexpr int RoleMaskCount = 1 << RoleCount; 
+
+constexpr int roleBit(int role) {
+    return 1 << role;
+}
+
+// Multi-role masks, least flexible first 
+inline constexpr int FlexMasks[] = {
+    roleBit(Tank) | roleBit(Healer), roleBit(Tank) | roleBit(DPS), roleBit(Healer) | roleBit(DPS), 
+    roleBit(Tank) | roleBit(Healer) | roleBit(DPS)
+};
+
+// Party composition: number of slots per role 
+struct PartyTemplate {
+    const char* name; 
+    std::array<int, RoleCount> slots; 
+
+    constexpr int size() const {
+        int total = 0; 
+        for (int r = 0; r < RoleCount; ++r) {
+            total += slots[r];
+        }
+        return total;
+    }
+};
+
+// Built-in compositions 
+inline constexpr PartyTemplate DungeonParty{"Dungeon", {1, 1, 3}}; 
+inline constexpr PartyTemplate SmallDungeonParty{"Small Dungeon", {1, 1, 2}}; 
+inline constexpr PartyTemplate RaidParty{"Raid", {2, 5, 18}}; 
+
+static_assert(DungeonParty.size() == 5 && SmallDungeonParty.size() == 4 && RaidParty.size() == 25);
+
+// Upper bound on party size, for fixed-size claim buffers 
+inline constexpr int MaxPartySize = 40; 
+static_assert(RaidParty.size() <= MaxPartySize);
+
+// Pre-made groups are bucketed by role shape (tanks, healers, DPS), each 0..MaxGroupSize 
+inline constexpr int MaxGroupSize = 5; 
+inline constexpr int ShapeBase = MaxGroupSize + 1; 
+inline constexpr int ShapeCount = ShapeBase * ShapeBase * ShapeBase; 
+inline constexpr int ShapeWords = (ShapeCount + 63) / 64; 
+inline constexpr int MaxGroupsPerParty = 8; 
+
+constexpr int shapeIndex(int tanks, int healers, int dps) {
+    return (tanks * ShapeBase + healers) * ShapeBase + dps;
+}
+
+constexpr std::array<int, RoleCount> shapeOf(int index) {
+    return {index / (ShapeBase * ShapeBase), (index / ShapeBase) % ShapeBase, index % ShapeBase};
+}
+
+// Per-player queue records, readable without locks. Records live in fixed chunks that are 
+// never moved, so a reader that sees an id below count() can read its record while 
+// writers (holding the LFGSystem mutex) keep appending. 
+class PlayerTable {
+public: 
+    // Player lifecycle: Queued -> Matched, or Queued -> Cancelled. Claimed is held only while 
+    // the matcher (under the LFGSystem mutex) collects a party and may fall back to Queued. 
+    enum State : uint8_t { Queued, Claimed, Matched, Cancelled };
+
+    struct Record {
+        std::atomic<uint8_t> state; 
+        uint8_t roleMask;     // queue the player waits in (single role bit or flex mask) 
+        uint8_t tier;         // priority tier (Tier) 
+        int64_t enqueuedAt;   // steady clock, nanoseconds 
+        uint64_t ticket;      // position in that queue and tier's arrival order 
+        int readyCheck;       // pending ready check id, -1 if none (guarded by the LFGSystem mutex) 
+    };
+
+    static constexpr int ChunkBits = 16; 
+    static constexpr int ChunkSize = 1 << ChunkBits; 
+    static constexpr int MaxChunks = 1 << 12; 
+
+    PlayerTable() = default; 
+    PlayerTable(const PlayerTable&) = delete; 
+    PlayerTable& operator=(const PlayerTable&) = delete; 
+
+    ~PlayerTable() {
+        for (int c = mappedChunks; c < MaxChunks; ++c) {
+            delete[] chunks[c].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Serve the first capacity records (rounded down to whole chunks) from external memory, 
+    // e.g. a memory-mapped state file, mirroring the published count into persistedCount. 
+    // Must be called before any id is prepared. 
+    void attach(Record* base, int capacity, std::atomic<int32_t>* persistedCount) {
+        mappedChunks = std::min(capacity / ChunkSize, MaxChunks); 
+        for (int c = 0; c < mappedChunks; ++c) {
+            chunks[c].store(base + static_cast<size_t>(c) * ChunkSize, std::memory_order_release);
+        }
+        persisted = persistedCount;
+    }
+
+    int mappedCapacity() const {
+        return mappedChunks * ChunkSize;
+    }
+
+    // Writer side: slot for the next id (caller serializes writers) 
+    Record* prepare(int id) {
+        auto& chunk = chunks[id >> ChunkBits]; 
+        Record* records = chunk.load(std::memory_order_relaxed); 
+        if (records == nullptr) {
+            records = new Record[ChunkSize]; 
+            chunk.store(records, std::memory_order_release);
+        }
+        return &records[id & (ChunkSize - 1)];
+    }
+
+    // Writer side: allocate every chunk needed for ids below count now, so later enqueues don't 
+    void reserve(int count) {
+        int needed = std::min((count + ChunkSize - 1) >> ChunkBits, MaxChunks); 
+        for (int c = 0; c < needed; ++c) {
+            if (chunks[c].load(std::memory_order_relaxed) == nullptr) {
+                chunks[c].store(new Record[ChunkSize], std::memory_order_release);
+            }
+        }
+    }
+
+    // Writer side: record of an id already prepared 
+    Record* at(int id) const {
+        return &chunks[id >> ChunkBits].load(std::memory_order_relaxed)[id & (ChunkSize - 1)];
+    }
+
+    // Writer side: make ids below count visible to readers 
+    void publish(int count) {
+        published.store(count, std::memory_order_release); 
+        if (persisted != nullptr) {
+            persisted->store(std::min(count, mappedCapacity()), std::memory_order_release);
+        }
+    }
+
+    int count() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+    // Reader side: nullptr if the id was never published 
+    Record* find(int id) const {
+        if (id < 0 || id >= count()) {
+            return nullptr;
+        }
+        return &chunks[id >> ChunkBits].load(std::memory_order_acquire)[id & (ChunkSize - 1)];
+    }
 
-class LFGSystem {
 private: 
-    // Synchronization primitives 
+    std::array<std::atomic<Record*>, MaxChunks> chunks{}; 
+    std::atomic<int> published{0}; 
+    int mappedChunks = 0; 
+    std::atomic<int32_t>* persisted = nullptr;
+};
+
+static_assert(sizeof(PlayerTable::Record) == 32 && std::atomic<uint8_t>::is_always_lock_free);
+
+// Memory-mapped queue state. Player records are written in place by the PlayerTable, and the 
+// published count is stored after each batch of records is complete, so after a crash every 
+// record below playerCount is whole; state changes are single-byte stores. Data reaches the 
+// page cache immediately (surviving a process crash); sync() also flushes it to disk. 
+struct StateHeader {
+    static constexpr int MaxInstances = MaxInstanceCount; 
+
+    char magic[8];                      // "LFGSTATE" 
+    uint32_t version; 
+    uint32_t recordSize; 
+    int32_t capacity; 
+    std::atomic<int32_t> playerCount; 
+    int64_t clockOffsetNs;              // system_clock - steady_clock when last attached 
+    int32_t instances; 
+    int32_t reserved; 
+    struct {
+        int32_t partiesServed; 
+        int32_t totalTimeServed;
+    } instanceStats[MaxInstances];
+};
+
+inline constexpr char StateMagic[8] = {'L', 'F', 'G', 'S', 'T', 'A', 'T', 'E'};
+inline constexpr uint32_t StateVersion = 2;   // 2: a stats slot for every instance (was 256) 
+inline constexpr size_t StateRecordsOffset = (sizeof(StateHeader) + 4095) / 4096 * 4096;
+
+class StateFile {
+public: 
+    StateFile() = default; 
+    StateFile(const StateFile&) = delete; 
+    StateFile& operator=(const StateFile&) = delete; 
+
+    ~StateFile() {
+        close();
+    }
+
+    // Map an existing state file, or create one for capacity players. Sets recovered when the 
+    // file already held valid state. 
+    bool open(const std::string& path, int capacity, bool& recovered) {
+#ifdef LFG_HAVE_MMAP
+        recovered = false; 
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644); 
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info; 
+        if (::fstat(fd, &info) != 0) {
+            close(); 
+            return false;
+        }
+        if (info.st_size >= static_cast<off_t>(StateRecordsOffset)) {
+            StateHeader existing; 
+            if (::pread(fd, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing)) && 
+                std::memcmp(existing.magic, StateMagic, sizeof(StateMagic)) == 0) {
+                // Another layout's queued players would be lost if the file were recreated 
+                if (existing.version != StateVersion || existing.recordSize != sizeof(PlayerTable::Record)) {
+                    close(); 
+                    return false;
+                }
+                capacity = existing.capacity; 
+                recovered = true;
+            }
+        }
+
+        // Sparse file: untouched record pages cost nothing on disk 
+        size = StateRecordsOffset + static_cast<size_t>(capacity) * sizeof(PlayerTable::Record); 
+        if ((!recovered && ::ftruncate(fd, 0) != 0) || ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            close(); 
+            return false;
+        }
+        void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); 
+        if (mapping == MAP_FAILED) {
+            close(); 
+            return false;
+        }
+        base = static_cast<char*>(mapping); 
+
+        if (!recovered) {
+            StateHeader* fresh = new (base) StateHeader{}; 
+            std::memcpy(fresh->magic, StateMagic, sizeof(StateMagic)); 
+            fresh->version = StateVersion; 
+            fresh->recordSize = sizeof(PlayerTable::Record); 
+            fresh->capacity = capacity;
+        }
+        return true;
+#else
+        (void)path; 
+        (void)capacity; 
+        recovered = false; 
+        return false;
+#endif
+    }
+
+    StateHeader* header() const {
+        return reinterpret_cast<StateHeader*>(base);
+    }
+
+    PlayerTable::Record* records() const {
+        return reinterpret_cast<PlayerTable::Record*>(base + StateRecordsOffset);
+    }
+
+    void sync() {
+#ifdef LFG_HAVE_MMAP
+        if (base != nullptr) {
+            ::msync(base, size, MS_SYNC);
+        }
+#endif
+    }
+
+    void close() {
+#ifdef LFG_HAVE_MMAP
+        if (base != nullptr) {
+            ::munmap(base, size); 
+            base = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd); 
+            fd = -1;
+        }
+#endif
+    }
+
+private: 
+    int fd = -1; 
+    char* base = nullptr; 
+    size_t size = 0;
+};
+
+// Answer to a queue position query 
+struct QueueEstimate {
+    bool queued = false;              // false once matched or for unknown ids 
+    int roleMask = 0; 
+    long long position = 0;           // 1-based position in the player's queue and tier; an upper bound 
+    double estimatedWaitSeconds = -1; // -1 when no estimate is possible yet 
+};
+
+// One player in a bulk enqueue 
+struct PlayerRequest {
+    uint8_t roleMask;          // acceptable roles (roleBit values) 
+    uint8_t tier = Standard;
+};
+
+// HDR-style latency histogram over nanoseconds: each power of two is split into 16 linear 
+// sub-buckets, so percentiles are within 1/16 of the true value (not thread-safe; guard externally) 
+class LatencyHistogram {
+public: 
+    static constexpr int SubBits = 4; 
+    static constexpr int SubBuckets = 1 << SubBits; 
+    static constexpr int Buckets = (64 - SubBits + 1) * SubBuckets; 
+
+    static int bucketOf(uint64_t value) {
+        if (value < SubBuckets) {
+            return static_cast<int>(value);
+        }
+        int exponent = std::bit_width(value) - 1; 
+        return (exponent - SubBits + 1) * SubBuckets + static_cast<int>((value >> (exponent - SubBits)) & (SubBuckets - 1));
+    }
+
+    // Largest value that falls in bucket b 
+    static uint64_t bucketCeiling(int b) {
+        if (b < SubBuckets) {
+            return static_cast<uint64_t>(b);
+        }
+        int shift = b / SubBuckets - 1; 
+        uint64_t lower = static_cast<uint64_t>(SubBuckets + b % SubBuckets) << shift; 
+        return lower + ((uint64_t{1} << shift) - 1);
+    }
+
+    void record(int64_t ns) {
+        uint64_t value = static_cast<uint64_t>(std::max<int64_t>(ns, 0)); 
+        buckets[bucketOf(value)]++; 
+        samples++; 
+        sum += value; 
+        maximum = std::max(maximum, value);
+    }
+
+    uint64_t count() const {
+        return samples;
+    }
+
+    double meanMs() const {
+        return samples == 0 ? 0.0 : sum / 1e6 / samples;
+    }
+
+    double maxMs() const {
+        return maximum / 1e6;
+    }
+
+    // Upper bound of the bucket holding the p-th percentile (0 < p <= 100) 
+    double percentileMs(double p) const {
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * samples)); 
+        uint64_t seen = 0; 
+        for (int b = 0; b < Buckets; ++b) {
+            seen += buckets[b]; 
+            if (seen >= rank && seen > 0) {
+                return std::min(bucketCeiling(b), maximum) / 1e6;
+            }
+        }
+        return maxMs();
+    }
+
+private: 
+    std::array<uint64_t, Buckets> buckets{}; 
+    uint64_t samples = 0; 
+    uint64_t sum = 0; 
+    uint64_t maximum = 0;
+};
+
+// FIFO on a power-of-two ring buffer that also accepts pushes at the front. Unlike std::deque it 
+// keeps its storage as it drains, so a queue cycling at a steady depth never allocates. 
+template <typename T>
+class RingQueue {
+public: 
+    bool empty() const {
+        return head == tail;
+    }
+
+    size_t size() const {
+        return tail - head;
+    }
+
+    const T& front() const {
+        return slots[head & mask];
+    }
+
+    void push_back(const T& value) {
+        reserve(size() + 1); 
+        slots[tail++ & mask] = value;
+    }
+
+    void push_front(const T& value) {
+        reserve(size() + 1); 
+        slots[--head & mask] = value;
+    }
+
+    void pop_front() {
+        head++;
+    }
+
+    // Grow (doubling) until count entries fit 
+    void reserve(size_t count) {
+        if (count <= slots.size()) {
+            return;
+        }
+        size_t capacity = std::max<size_t>(slots.size() * 2, 16); 
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        std::vector<T> grown(capacity); 
+        for (size_t i = 0; i < size(); ++i) {
+            grown[i] = slots[(head + i) & mask];
+        }
+        tail = size(); 
+        head = 0; 
+        slots = std::move(grown); 
+        mask = capacity - 1;
+    }
+
+private: 
+    std::vector<T> slots; 
+    size_t mask = 0; 
+    size_t head = 0;   // free-running; indexes wrap through mask 
+    size_t tail = 0;
+};
+
+// Multi-level FIFO of player ids, one ring per tier. Which tier to pop is decided by the 
+// owner (it needs the players' enqueue times for aging), so every operation is O(1). 
+class TieredQueue {
+public: 
+    void push_back(int id, int tier) {
+        tiers[tier].push_back(id);
+    }
+
+    void push_front(int id, int tier) {
+        tiers[tier].push_front(id);
+    }
+
+    // Append count consecutive ids starting at firstId after a single capacity check 
+    void append_range(int firstId, int count, int tier) {
+        auto& queue = tiers[tier]; 
+        queue.reserve(queue.size() + count); 
+        for (int i = 0; i < count; ++i) {
+            queue.push_back(firstId + i);
+        }
+    }
+
+    bool empty() const {
+        for (const auto& tier : tiers) {
+            if (!tier.empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool empty(int tier) const {
+        return tiers[tier].empty();
+    }
+
+    // Only the Standard tier has entries (the common case) 
+    bool standardOnly() const {
+        for (int t = Standard + 1; t < TierCount; ++t) {
+            if (!tiers[t].empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int front(int tier) const {
+        return tiers[tier].front();
+    }
+
+    void pop_front(int tier) {
+        tiers[tier].pop_front();
+    }
+
+private: 
+    std::array<RingQueue<int>, TierCount> tiers;
+};
+
+// 1 / (1 + standard deviation of parties served per instance); 1 is perfectly even 
+inline double fairnessOf(std::span<const int> served) {
+    if (served.empty()) {
+        return 1.0;
+    }
+    double average = std::accumulate(served.begin(), served.end(), 0.0) / served.size(); 
+    double fairness = 0.0; 
+    for (int parties : served) {
+        double diff = parties - average; 
+        fairness += diff * diff;
+    }
+    return 1.0 / (1.0 + std::sqrt(fairness / served.size()));
+}
+
+// splitmix64 finalizer: spreads a seed plus counter into an independent 64-bit value 
+inline uint64_t mixSeed(uint64_t z) {
+    z += 0x9E3779B97F4A7C15ull; 
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull; 
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull; 
+    return z ^ (z >> 31);
+}
+
+// Append-only list whose elements never move. Each element is allocated on its own and published 
+// by a release store of the count, so other threads may use any element below size() while the 
+// owner appends (appends must be serialized by the owner). 
+template <typename T, size_t Capacity>
+class StableList {
+public: 
+    template <bool Const>
+    class Iterator {
+    public: 
+        using List = std::conditional_t<Const, const StableList, StableList>; 
+        Iterator(List* list, size_t index) : list(list), index(index) {}
+        auto& operator*() const { return (*list)[index]; }
+        Iterator& operator++() { ++index; return *this; }
+        bool operator!=(const Iterator& other) const { return index != other.index; }
+    private: 
+        List* list; 
+        size_t index;
+    };
+
+    // Returns nullptr once Capacity elements exist 
+    template <typename... Args>
+    T* emplace_back(Args&&... args) {
+        size_t n = count.load(std::memory_order_relaxed); 
+        if (n == Capacity) {
+            return nullptr;
+        }
+        slots[n] = std::make_unique<T>(std::forward<Args>(args)...); 
+        count.store(n + 1, std::memory_order_release); 
+        return slots[n].get();
+    }
+
+    T& operator[](size_t i) { return *slots[i]; }
+    const T& operator[](size_t i) const { return *slots[i]; }
+    size_t size() const { return count.load(std::memory_order_acquire); }
+    Iterator<false> begin() { return {this, 0}; }
+    Iterator<false> end() { return {this, size()}; }
+    Iterator<true> begin() const { return {this, 0}; }
+    Iterator<true> end() const { return {this, size()}; }
+
+private: 
+    std::array<std::unique_ptr<T>, Capacity> slots; 
+    std::atomic<size_t> count{0};
+};
+
+// Instance autoscaling: instances are added while complete parties wait with no instance free, 
+// and retired after sitting idle with nothing queued. Separate streaks for each direction and a 
+// cooldown after every change keep the pool from flapping. 
+struct AutoscalePolicy {
+    bool enabled = false; 
+    int minInstances = 1; 
+    int maxInstances = 64; 
+    int intervalMs = 250;        // sampling period 
+    int scaleUpWaitMs = 500;     // the oldest queued player must have waited at least this long 
+    int scaleUpSamples = 2;      // consecutive samples under pressure before adding instances 
+    int scaleDownSamples = 8;    // consecutive idle samples before retiring one instance 
+    int cooldownMs = 1000;       // no further change for this long after one 
+};
+
+// Simulated mid-dungeon departures that trigger backfill requests 
+struct BackfillPolicy {
+    double leaveRate = 0.0; // probability that a running dungeon loses one member 
+};
+
+// Binary trace of an LFG session: a TraceHeader, one TraceTemplate per instance (version 2 on) 
+// and fixed-size TraceRecords, so a trace can be mmapped and indexed directly. 
+enum TraceEvent : uint8_t { TraceEnqueue = 1, TraceGroup, TraceCancel, TraceFormed, TraceDungeonStart, TraceDungeonEnd };
+
+struct TraceHeader {
+    char magic[8];             // "LFGTRACE" 
+    uint32_t version; 
+    uint32_t recordSize; 
+    int32_t instances; 
+    int32_t minTime; 
+    int32_t maxTime; 
+    int32_t reserved;
+};
+
+struct TraceRecord {
+    int64_t timestampNs;       // since the trace started 
+    uint8_t type;              // TraceEvent 
+    uint8_t roleMask;          // Enqueue: queue; Group: 0 
+    uint8_t tier; 
+    uint8_t reserved; 
+    int32_t instance;          // Formed / DungeonStart / DungeonEnd, else -1 
+    int32_t id;                // Enqueue: first player id; Group: group id; Cancel: player id 
+    int32_t value;             // Enqueue: players; Group: shape index; Formed: party size; Dungeon: seconds 
+    int32_t extra;             // Formed: pre-made groups in the party 
+    int32_t padding;
+};
+
+// Party template an instance served while recording 
+struct TraceTemplate {
+    char name[20];             // NUL-terminated, truncated if longer 
+    int32_t slots[RoleCount];
+};
+
+static_assert(sizeof(TraceHeader) == 32 && sizeof(TraceRecord) == 32 && sizeof(TraceTemplate) == 32);
+
+inline constexpr char TraceMagic[8] = {'L', 'F', 'G', 'T', 'R', 'A', 'C', 'E'};
+inline constexpr uint32_t TraceVersion = 2;   // 2: templates after the header 
+
+// Buffered, thread-safe trace writer 
+class TraceRecorder {
+public: 
+    TraceRecorder(const std::string& path, const std::vector<const PartyTemplate*>& parties, int minTime, int maxTime) 
+        : file(std::fopen(path.c_str(), "wb")), start(std::chrono::steady_clock::now()) {
+        if (file == nullptr) {
+            return;
+        }
+        TraceHeader header{}; 
+        std::memcpy(header.magic, TraceMagic, sizeof(header.magic)); 
+        header.version = TraceVersion; 
+        header.recordSize = sizeof(TraceRecord); 
+        header.instances = static_cast<int32_t>(parties.size()); 
+        header.minTime = minTime; 
+        header.maxTime = maxTime; 
+        write(&header, sizeof(header), 1); 
+        for (const PartyTemplate* party : parties) {
+            TraceTemplate entry{}; 
+            std::snprintf(entry.name, sizeof(entry.name), "%s", party->name); 
+            for (int r = 0; r < RoleCount; ++r) {
+                entry.slots[r] = party->slots[r];
+            }
+            write(&entry, sizeof(entry), 1);
+        }
+        buffer.reserve(BufferRecords);
+    }
+
+    ~TraceRecorder() {
+        close();
+    }
+
+    bool ok() const {
+        return file != nullptr;
+    }
+
+    void record(TraceEvent type, int instance, int id, int value, int roleMask = 0, int tier = 0, int extra = 0) {
+        TraceRecord entry{}; 
+        entry.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count(); 
+        entry.type = type; 
+        entry.roleMask = static_cast<uint8_t>(roleMask); 
+        entry.tier = static_cast<uint8_t>(tier); 
+        entry.instance = instance; 
+        entry.id = id; 
+        entry.value = value; 
+        entry.extra = extra; 
+
+        std::lock_guard<std::mutex> lock(mtx); 
+        buffer.push_back(entry); 
+        if (buffer.size() == BufferRecords) {
+            flush();
+        }
+    }
+
+    // Flush and close; returns the errno of the first failed write, or 0 
+    int close() {
+        std::lock_guard<std::mutex> lock(mtx); 
+        if (file != nullptr) {
+            flush(); 
+            if (std::fclose(file) != 0 && failure == 0) {
+                failure = errno;
+            }
+            file = nullptr;
+        }
+        return failure;
+    }
+
+private: 
+    static constexpr size_t BufferRecords = 4096; 
+
+    // mtx must be held 
+    void flush() {
+        if (file != nullptr && !buffer.empty()) {
+            write(buffer.data(), sizeof(TraceRecord), buffer.size());
+        }
+        buffer.clear();
+    }
+
+    // Write whole items, keeping the errno of the first short write; later writes are skipped so 
+    // the file never has a gap in the middle (mtx must be held, or called from the constructor) 
+    void write(const void* data, size_t size, size_t count) {
+        if (failure == 0 && std::fwrite(data, size, count, file) != count) {
+            failure = errno != 0 ? errno : EIO;
+        }
+    }
+
     std::mutex mtx; 
-    std::condition_variable cv; 
-    std::mutex cout_mtx;
+    std::FILE* file; 
+    int failure = 0; 
+    std::chrono::steady_clock::time_point start; 
+    std::vector<TraceRecord> buffer;
+};
+
+// Read a whole trace. Version 1 traces carry no templates; their instances all served DungeonParty. 
+// A file that doesn't end on a record boundary (the recorder died mid-write) loads every whole 
+// record and sets truncated. 
+inline bool loadTrace(const std::string& path, TraceHeader& header, std::vector<TraceTemplate>& templates, 
+                      std::vector<TraceRecord>& records, bool& truncated) {
+    std::ifstream in(path, std::ios::binary); 
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || 
+        std::memcmp(header.magic, TraceMagic, sizeof(header.magic)) != 0 || header.recordSize != sizeof(TraceRecord) || 
+        header.version < 1 || header.version > TraceVersion || header.instances < 0 || header.instances > MaxInstanceCount) {
+        return false;
+    }
+    templates.clear(); 
+    if (header.version >= 2) {
+        templates.resize(header.instances); 
+        if (!in.read(reinterpret_cast<char*>(templates.data()), templates.size() * sizeof(TraceTemplate))) {
+            return false;
+        }
+        for (auto& entry : templates) {
+            entry.name[sizeof(entry.name) - 1] = '\0';
+        }
+    }
+    size_t offset = sizeof(header) + templates.size() * sizeof(TraceTemplate); 
+    in.seekg(0, std::ios::end); 
+    size_t size = static_cast<size_t>(in.tellg()); 
+    size_t count = (size - offset) / sizeof(TraceRecord); 
+    truncated = (size - offset) % sizeof(TraceRecord) != 0; 
+    in.seekg(static_cast<std::streamoff>(offset)); 
+    records.resize(count); 
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(records.data()), count * sizeof(TraceRecord)));
+}
+
+// Timeline events for the Chrome trace export 
+enum TimelineKind : uint8_t { TimelineDungeon, TimelinePartyWait, TimelineBackoff, TimelineLockWait, TimelineWalWait, 
+                              TimelineFormed, TimelineQueued, TimelineKindCount };
+
+struct TimelineKindInfo {
+    const char* name; 
+    char phase;                  // 'X' span, 'i' instant, 'C' counter 
+    const char* args[3];         // names of the recorded values, nullptr if unused 
+};
+
+inline constexpr TimelineKindInfo timelineKinds[TimelineKindCount] = {
+    {"Dungeon", 'X', {"players", "groups", "seconds"}}, 
+    {"Waiting for party", 'X', {"wakeups", "formed", nullptr}}, 
+    {"Backoff sleep", 'X', {"ms", nullptr, nullptr}}, 
+    {"Lock wait", 'X', {nullptr, nullptr, nullptr}}, 
+    {"WAL durability wait", 'X', {nullptr, nullptr, nullptr}}, 
+    {"Party formed", 'i', {"players", "groups", nullptr}}, 
+    {"Queued", 'C', {"Tanks", "Healers", "DPS"}}
+};
+
+// Instance timelines in Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Each thread 
+// appends to its own buffer without locking; write() emits every buffer once the threads 
+// have stopped. Buffers are sized once, so recording never allocates; a thread's events past 
+// BufferEvents are counted as dropped. 
+class TimelineTracer {
+public: 
+    static constexpr size_t BufferEvents = size_t{1} << 15; 
+
+    explicit TimelineTracer(std::string path) 
+        : path(std::move(path)), start(std::chrono::steady_clock::now()), id(nextId.fetch_add(1) + 1) {}
+
+    TimelineTracer(const TimelineTracer&) = delete; 
+    TimelineTracer& operator=(const TimelineTracer&) = delete; 
+
+    // Nanoseconds since the tracer was created 
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Label the calling thread's track 
+    void nameThread(int tid, std::string name) {
+        Buffer& buffer = local(); 
+        buffer.tid = tid; 
+        buffer.name = std::move(name);
+    }
+
+    void span(TimelineKind kind, int64_t beginNs, int64_t endNs, int a = 0, int b = 0, int c = 0) {
+        append(Event{kind, beginNs, endNs - beginNs, {a, b, c}});
+    }
+
+    void instant(TimelineKind kind, int a = 0, int b = 0, int c = 0) {
+        append(Event{kind, now(), 0, {a, b, c}});
+    }
+
+    // Write all buffers as one JSON document; call once no thread is recording 
+    bool write() {
+        std::FILE* file = std::fopen(path.c_str(), "w"); 
+        if (file == nullptr) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(buffersMtx); 
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file); 
+        bool first = true; 
+        auto separator = [&]() {
+            std::fputs(first ? "\n" : ",\n", file); 
+            first = false;
+        };
+        for (const auto& buffer : buffers) {
+            if (!buffer->name.empty()) {
+                separator(); 
+                std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", 
+                             buffer->tid, buffer->name.c_str());
+            }
+            for (const Event& event : buffer->events) {
+                const TimelineKindInfo& info = timelineKinds[event.kind]; 
+                separator(); 
+                std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", 
+                             info.name, info.phase, buffer->tid, event.beginNs / 1e3); 
+                if (info.phase == 'X') {
+                    std::fprintf(file, ",\"dur\":%.3f", event.durationNs / 1e3);
+                } else if (info.phase == 'i') {
+                    std::fputs(",\"s\":\"t\"", file);
+                }
+                std::fputs(",\"args\":{", file); 
+                for (int a = 0; a < 3 && info.args[a] != nullptr; ++a) {
+                    std::fprintf(file, "%s\"%s\":%d", a == 0 ? "" : ",", info.args[a], event.args[a]);
+                }
+                std::fputs("}}", file);
+            }
+        }
+        std::fputs("\n]}\n", file); 
+        return std::fclose(file) == 0;
+    }
+
+    size_t eventCount() const {
+        std::lock_guard<std::mutex> lock(buffersMtx); 
+        size_t total = 0; 
+        for (const auto& buffer : buffers) {
+            total += buffer->events.size();
+        }
+        return total;
+    }
+
+    // Events left out because their thread's buffer was full; call once no thread is recording 
+    size_t droppedCount() const {
+        std::lock_guard<std::mutex> lock(buffersMtx); 
+        size_t total = 0; 
+        for (const auto& buffer : buffers) {
+            total += buffer->dropped;
+        }
+        return total;
+    }
+
+private: 
+    struct Event {
+        TimelineKind kind; 
+        int64_t beginNs; 
+        int64_t durationNs; 
+        std::array<int, 3> args;
+    };
+
+    struct Buffer {
+        std::thread::id owner; 
+        int tid = 0; 
+        std::string name; 
+        std::vector<Event> events; 
+        size_t dropped = 0;
+    };
+
+    void append(const Event& event) {
+        Buffer& buffer = local(); 
+        if (buffer.events.size() < BufferEvents) {
+            buffer.events.push_back(event);
+        } else {
+            buffer.dropped++;
+        }
+    }
+
+    // The calling thread's buffer, created on first use (same caching as MetricsRegistry::local) 
+    Buffer& local() {
+        thread_local uint64_t cachedId = 0; 
+        thread_local Buffer* cached = nullptr; 
+        if (cachedId != id) {
+            std::thread::id self = std::this_thread::get_id(); 
+            std::lock_guard<std::mutex> lock(buffersMtx); 
+            auto it = std::find_if(buffers.begin(), buffers.end(), [self](const auto& buffer) { return buffer->owner == self; }); 
+            if (it == buffers.end()) {
+                buffers.push_back(std::make_unique<Buffer>()); 
+                buffers.back()->owner = self; 
+                buffers.back()->tid = 1000 + static_cast<int>(buffers.size()); 
+                buffers.back()->events.reserve(BufferEvents); 
+                it = buffers.end() - 1;
+            }
+            cached = it->get(); 
+            cachedId = id;
+        }
+        return *cached;
+    }
+
+    std::string path; 
+    std::chrono::steady_clock::time_point start; 
+    uint64_t id; 
+    mutable std::mutex buffersMtx; 
+    std::vector<std::unique_ptr<Buffer>> buffers; 
+    static inline std::atomic<uint64_t> nextId{0};
+};
+
+#ifdef LFG_HAVE_IO_URING
+// Minimal io_uring wrapper over the raw syscalls (no liburing dependency). Entries are prepared 
+// with next(), all of them are handed to the kernel by one submit() call that can also wait for 
+// completions, and drain() consumes every completion that is ready. Single-threaded use only. 
+class IoRing {
+public: 
+    IoRing() = default; 
+    IoRing(const IoRing&) = delete; 
+    IoRing& operator=(const IoRing&) = delete; 
+
+    ~IoRing() {
+        close();
+    }
+
+    // Set up the ring and map it; on any failure, close() releases whatever was set up so far 
+    bool open(unsigned entries, unsigned completions) {
+        close(); 
+        io_uring_params params{}; 
+        params.flags = IORING_SETUP_CQSIZE; 
+        params.cq_entries = completions; 
+        ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)); 
+        if (ringFd < 0) {
+            return false;
+        }
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            close(); 
+            return false;
+        }
+
+        ringBytes = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned), 
+                                     params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe)); 
+        sqeBytes = params.sq_entries * sizeof(io_uring_sqe); 
+        void* ring = ::mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING); 
+        if (ring == MAP_FAILED) {
+            close(); 
+            return false;
+        }
+        base = static_cast<char*>(ring); 
+        void* entriesMap = ::mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES); 
+        if (entriesMap == MAP_FAILED) {
+            close(); 
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(entriesMap); 
+        sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head); 
+        sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail); 
+        sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask); 
+        sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array); 
+        cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head); 
+        cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail); 
+        cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask); 
+        cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes); 
+        sqEntries = params.sq_entries; 
+        localTail = *sqTail; 
+        return true;
+    }
+
+    // Release the mappings and the ring fd; safe on a ring that is only partly set up 
+    void close() {
+        if (sqes != nullptr) {
+            ::munmap(sqes, sqeBytes); 
+            sqes = nullptr;
+        }
+        if (base != nullptr) {
+            ::munmap(base, ringBytes); 
+            base = nullptr;
+        }
+        if (ringFd >= 0) {
+            ::close(ringFd); 
+            ringFd = -1;
+        }
+    }
+
+    // A zeroed submission entry; submits what is queued first if the ring is full 
+    io_uring_sqe& next() {
+        if (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            submit(0);
+        }
+        unsigned index = localTail & sqMask; 
+        sqArray[index] = index; 
+        localTail++; 
+        io_uring_sqe& sqe = sqes[index]; 
+        std::memset(&sqe, 0, sizeof(sqe)); 
+        return sqe;
+    }
+
+    // Hand every prepared entry to the kernel and wait for at least waitFor completions, in one 
+    // syscall. Returns false on error. 
+    bool submit(unsigned waitFor) {
+        unsigned pending = localTail - *sqTail; 
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE); 
+        syscalls++; 
+        for (;;) {
+            long result = ::syscall(__NR_io_uring_enter, ringFd, pending, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, 
+                                    nullptr, 0); 
+            if (result >= 0) {
+                return true;
+            }
+            if (errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+                return false;
+            }
+            if (errno != EINTR) {
+                return true;    // completion queue backed up: caller drains and comes back 
+            }
+        }
+    }
+
+    // Pass every available completion to handle; returns how many there were 
+    template <typename Handler>
+    unsigned drain(Handler&& handle) {
+        unsigned head = *cqHead, count = 0; 
+        for (unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE); head != tail; 
+             tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            for (; head != tail; ++head, ++count) {
+                io_uring_cqe cqe = cqes[head & cqMask]; 
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE); 
+                handle(cqe);
+            }
+        }
+        return count;
+    }
+
+    uint64_t syscallCount() const {
+        return syscalls;
+    }
+
+private: 
+    int ringFd = -1; 
+    char* base = nullptr; 
+    size_t ringBytes = 0; 
+    size_t sqeBytes = 0; 
+    io_uring_sqe* sqes = nullptr; 
+    unsigned* sqHead = nullptr; 
+    unsigned* sqTail = nullptr; 
+    unsigned* sqArray = nullptr; 
+    unsigned sqMask = 0; 
+    unsigned sqEntries = 0; 
+    unsigned localTail = 0; 
+    unsigned* cqHead = nullptr; 
+    unsigned* cqTail = nullptr; 
+    io_uring_cqe* cqes = nullptr; 
+    unsigned cqMask = 0; 
+    uint64_t syscalls = 0;
+};
+#endif
+
+// Write-ahead log of matchmaking decisions. Each entry is a WalEntry header followed by 
+// playerCount player ids and groupCount group ids (int32 each); checksum covers the whole 
+// entry with checksum zeroed, so a torn tail is detected on read. 
+enum WalEntryType : uint8_t { WalPartyStarted = 1, WalDungeonCompleted = 2, WalDungeonAborted = 3, WalPlayerBackfilled = 4 };
+
+struct WalEntry {
+    uint32_t length;            // bytes including this header 
+    uint32_t checksum;          // FNV-1a 
+    uint64_t lsn; 
+    int64_t wallTimeNs;         // system_clock 
+    uint8_t type;               // WalEntryType 
+    uint8_t playerCount; 
+    uint8_t groupCount; 
+    uint8_t reserved; 
+    int32_t instance; 
+    int32_t value;              // dungeon seconds for completions, seconds run for aborts 
+    int32_t padding;
+};
+
+static_assert(sizeof(WalEntry) == 40);
+
+inline uint32_t fnv1a(const void* data, size_t length) {
+    const auto* bytes = static_cast<const unsigned char*>(data); 
+    uint32_t hash = 2166136261u; 
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Append-only log with group commit: producers append to an in-memory batch and get an LSN; 
+// one writer thread writes the batch and issues a single fdatasync for all of it, so every 
+// append that lands while a sync is in flight shares the next one. A failed write or sync is 
+// sticky: nothing after it is reported durable, and later batches are dropped. 
+class WriteAheadLog {
+public: 
+    WriteAheadLog() = default; 
+    WriteAheadLog(const WriteAheadLog&) = delete; 
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete; 
+
+    ~WriteAheadLog() {
+        close();
+    }
+
+    // With useRing, each batch is one linked write + fdatasync submission on an io_uring (a single 
+    // syscall) instead of write() then fdatasync(); falls back to the syscalls if unavailable 
+    bool open(const std::string& path, bool useRing = false) {
+#ifdef LFG_HAVE_POSIX_IO
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644); 
+        if (fd < 0) {
+            return false;
+        }
+#ifdef LFG_HAVE_IO_URING
+        if (useRing) {
+            ring = std::make_unique<IoRing>(); 
+            if (!ring->open(8, 16)) {
+                ring.reset();
+            }
+        }
+#endif
+        (void)useRing; 
+#else
+        file = std::fopen(path.c_str(), "ab"); 
+        if (file == nullptr) {
+            return false;
+        }
+#endif
+        active.reserve(1 << 16); 
+        flushing.reserve(1 << 16); 
+        writer = std::thread([this]() {
+            writerLoop();
+        });
+        return true;
+    }
+
+    // Append one entry (its lsn and checksum are filled in here); returns the LSN 
+    uint64_t append(WalEntry& entry, const int32_t* ids) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        entry.lsn = ++nextLsn; 
+        entry.checksum = 0; 
+        size_t idBytes = entry.length - sizeof(WalEntry); 
+        uint32_t hash = fnv1a(&entry, sizeof(WalEntry)); 
+        const auto* idData = reinterpret_cast<const unsigned char*>(ids); 
+        for (size_t i = 0; i < idBytes; ++i) {
+            hash = (hash ^ idData[i]) * 16777619u;
+        }
+        entry.checksum = hash; 
+
+        const auto* header = reinterpret_cast<const char*>(&entry); 
+        active.insert(active.end(), header, header + sizeof(WalEntry)); 
+        active.insert(active.end(), reinterpret_cast<const char*>(ids), reinterpret_cast<const char*>(ids) + idBytes); 
+        appended++; 
+        pending.notify_one(); 
+        return entry.lsn;
+    }
+
+    // Block until every entry up to lsn is on disk; returns false if the log failed first 
+    bool waitDurable(uint64_t lsn) {
+        std::unique_lock<std::mutex> lock(mtx); 
+        durableCv.wait(lock, [this, lsn] { return durableLsn >= lsn || failure != 0 || finished; }); 
+        return durableLsn >= lsn;
+    }
+
+    // errno of the first failed write or sync, or 0 
+    int error() const {
+        std::lock_guard<std::mutex> lock(mtx); 
+        return failure;
+    }
+
+    uint64_t entries() const {
+        std::lock_guard<std::mutex> lock(mtx); 
+        return appended;
+    }
+
+    uint64_t syncs() const {
+        std::lock_guard<std::mutex> lock(mtx); 
+        return syncCount;
+    }
+
+    // Flush everything appended so far and stop the writer 
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx); 
+            if (!writer.joinable()) {
+                return;
+            }
+            stopping = true;
+        }
+        pending.notify_one(); 
+        writer.join(); 
+#ifdef LFG_HAVE_POSIX_IO
+        ::close(fd); 
+        fd = -1; 
+#else
+        std::fclose(file); 
+        file = nullptr; 
+#endif
+    }
+
+private: 
+    void writerLoop() {
+        std::unique_lock<std::mutex> lock(mtx); 
+        for (;;) {
+            pending.wait(lock, [this] { return stopping || !active.empty(); }); 
+            if (active.empty()) {
+                break;
+            }
+
+            std::swap(active, flushing); 
+            uint64_t upTo = nextLsn; 
+            bool failed = failure != 0; 
+            lock.unlock(); 
+
+            // Once a batch is lost the log has a gap, so nothing later may be called durable 
+            int result = failed ? 0 : writeAll(flushing.data(), flushing.size()); 
+            flushing.clear(); 
+
+            lock.lock(); 
+            if (result != 0) {
+                failure = result;
+            } else if (!failed) {
+                durableLsn = upTo; 
+                syncCount++;
+            }
+            durableCv.notify_all();
+        }
+        finished = true; 
+        durableCv.notify_all();
+    }
+
+    // Write and sync one batch; returns 0 or the errno of the first failure 
+    int writeAll(const char* data, size_t size) {
+#ifdef LFG_HAVE_IO_URING
+        if (ring) {
+            bool synced = false; 
+            while (size > 0 || !synced) {
+                io_uring_sqe& write = ring->next(); 
+                write.opcode = IORING_OP_WRITE; 
+                write.fd = fd; 
+                write.addr = reinterpret_cast<uint64_t>(data); 
+                write.len = static_cast<uint32_t>(std::min<size_t>(size, 1u << 30)); 
+                write.off = static_cast<uint64_t>(-1); 
+                write.flags = IOSQE_IO_LINK; 
+                io_uring_sqe& sync = ring->next(); 
+                sync.opcode = IORING_OP_FSYNC; 
+                sync.fd = fd; 
+                sync.fsync_flags = IORING_FSYNC_DATASYNC; 
+                sync.user_data = 1; 
+
+                // A short write cancels the linked sync; go round again for the rest 
+                unsigned done = 0; 
+                int error = 0; 
+                while (done < 2) {
+                    if (!ring->submit(1)) {
+                        return errno != 0 ? errno : EIO;
+                    }
+                    done += ring->drain([&](const io_uring_cqe& cqe) {
+                        if (cqe.user_data == 0) {
+                            if (cqe.res > 0) {
+                                data += cqe.res; 
+                                size -= static_cast<size_t>(cqe.res);
+                            } else if (error == 0) {
+                                error = cqe.res < 0 ? -cqe.res : EIO;
+                            }
+                        } else {
+                            synced = cqe.res == 0 && size == 0; 
+                            if (cqe.res < 0 && cqe.res != -ECANCELED && error == 0) {
+                                error = -cqe.res;
+                            }
+                        }
+                    });
+                }
+                if (error != 0) {
+                    return error;
+                }
+            }
+            return 0;
+        }
+#endif
+#ifdef LFG_HAVE_POSIX_IO
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size); 
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            data += written; 
+            size -= static_cast<size_t>(written);
+        }
+        return ::fdatasync(fd) == 0 ? 0 : errno; 
+#else
+        if (std::fwrite(data, 1, size, file) != size || std::fflush(file) != 0) {
+            return errno != 0 ? errno : EIO;
+        }
+        return 0; 
+#endif
+    }
+
+#ifdef LFG_HAVE_POSIX_IO
+    int fd = -1; 
+#else
+    std::FILE* file = nullptr; 
+#endif
+#ifdef LFG_HAVE_IO_URING
+    std::unique_ptr<IoRing> ring; 
+#endif
+    mutable std::mutex mtx; 
+    std::condition_variable pending; 
+    std::condition_variable durableCv; 
+    std::thread writer; 
+    std::vector<char> active, flushing; 
+    uint64_t nextLsn = 0; 
+    uint64_t durableLsn = 0; 
+    uint64_t appended = 0; 
+    uint64_t syncCount = 0; 
+    int failure = 0; 
+    bool stopping = false; 
+    bool finished = false;   // writer has flushed everything and exited 
+};
+
+// Counters kept in the metrics registry 
+enum MetricCounter { MetricPlayersMatched, MetricGroupsMatched, MetricCancellations, MetricBusyNs, MetricCounterCount };
+
+// Metrics for export. Hot-path updates go to the calling thread's own shard (one writer, so 
+// relaxed load+store with no shared cache lines); shards are only summed when exported. 
+class MetricsRegistry {
+public: 
+    static constexpr int Buckets = 64; 
+
+    struct alignas(64) Shard {
+        std::thread::id owner; 
+        std::atomic<int> instance{-1};   // instance run by the owning thread, if any 
+        std::array<std::atomic<uint64_t>, MetricCounterCount> counters{}; 
+        std::array<std::atomic<uint64_t>, Buckets + 1> waitBuckets{};   // power-of-two ns 
+        std::atomic<uint64_t> waitSum{0}; 
+
+        void add(MetricCounter counter, uint64_t value) {
+            auto& slot = counters[counter]; 
+            slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        void recordWait(int64_t ns) {
+            uint64_t value = static_cast<uint64_t>(std::max<int64_t>(ns, 0)); 
+            auto& bucket = waitBuckets[std::bit_width(value)]; 
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); 
+            waitSum.store(waitSum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+    };
+
+    // Sum of all shards 
+    struct Snapshot {
+        std::array<uint64_t, MetricCounterCount> counters{}; 
+        std::array<uint64_t, Buckets + 1> waitBuckets{}; 
+        uint64_t waitCount = 0; 
+        uint64_t waitSum = 0; 
+        std::vector<uint64_t> instanceBusyNs; 
+
+        // Upper bound of the bucket holding the p-th percentile, in seconds 
+        double waitPercentile(double p) const {
+            uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * waitCount)), seen = 0; 
+            for (int b = 0; b <= Buckets; ++b) {
+                seen += waitBuckets[b]; 
+                if (seen >= rank && seen > 0) {
+                    return b == 0 ? 0.0 : std::ldexp(1.0, b) / 1e9;
+                }
+            }
+            return 0.0;
+        }
+    };
+
+    MetricsRegistry() : id(nextId.fetch_add(1) + 1) {}
+
+    // The calling thread's shard, created on first use 
+    Shard& local() {
+        thread_local uint64_t cachedId = 0; 
+        thread_local Shard* cached = nullptr; 
+        if (cachedId != id) {
+            cached = &findOrCreate(); 
+            cachedId = id;
+        }
+        return *cached;
+    }
+
+    Snapshot snapshot(int instanceCount) const {
+        Snapshot total; 
+        total.instanceBusyNs.assign(instanceCount, 0); 
+        std::lock_guard<std::mutex> lock(shardsMtx); 
+        for (const auto& shard : shards) {
+            for (int c = 0; c < MetricCounterCount; ++c) {
+                total.counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+            }
+            for (int b = 0; b <= Buckets; ++b) {
+                uint64_t n = shard->waitBuckets[b].load(std::memory_order_relaxed); 
+                total.waitBuckets[b] += n; 
+                total.waitCount += n;
+            }
+            total.waitSum += shard->waitSum.load(std::memory_order_relaxed); 
+            int instance = shard->instance.load(std::memory_order_relaxed); 
+            if (instance >= 0 && instance < instanceCount) {
+                total.instanceBusyNs[instance] += shard->counters[MetricBusyNs].load(std::memory_order_relaxed);
+            }
+        }
+        return total;
+    }
+
+    uint64_t total(MetricCounter counter) const {
+        uint64_t sum = 0; 
+        std::lock_guard<std::mutex> lock(shardsMtx); 
+        for (const auto& shard : shards) {
+            sum += shard->counters[counter].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private: 
+    // Reuse this thread's shard if it has one (it may have switched registries), else add one 
+    Shard& findOrCreate() {
+        std::thread::id self = std::this_thread::get_id(); 
+        std::lock_guard<std::mutex> lock(shardsMtx); 
+        for (auto& shard : shards) {
+            if (shard->owner == self) {
+                return *shard;
+            }
+        }
+        shards.push_back(std::make_unique<Shard>()); 
+        shards.back()->owner = self; 
+        return *shards.back();
+    }
+
+    static inline std::atomic<uint64_t> nextId{0}; 
+    const uint64_t id; 
+    mutable std::mutex shardsMtx; 
+    std::vector<std::unique_ptr<Shard>> shards;
+};
+
+// A formed party's result, written once when the party is claimed and then shared by reference 
+// count with every consumer (logger, metrics, WAL, network front end), none of which copy it. 
+// Notices come from a NoticePool and return to it when the last reference goes away. 
+class NoticePool;
+
+struct MatchNotice {
+    std::atomic<int> refs{0}; 
+    uint64_t sequence = 0; 
+    int instanceId = -1; 
+    const PartyTemplate* party = nullptr; 
+    int64_t wallTimeNs = 0;                       // system_clock at formation 
+    int64_t formedAt = 0;                         // steady clock, nanoseconds 
+    int playerCount = 0; 
+    int groupCount = 0; 
+    std::array<int, RoleCount> remaining{};       // solo players left in each role queue 
+    std::array<int, MaxPartySize + MaxGroupsPerParty> ids;   // player ids, then group ids 
+    std::array<int64_t, MaxPartySize + MaxGroupsPerParty> enqueuedAt;   // steady clock, matching ids 
+    NoticePool* pool = nullptr; 
+    MatchNotice* nextFree = nullptr; 
+
+    std::span<const int> players() const {
+        return {ids.data(), static_cast<size_t>(playerCount)};
+    }
+
+    std::span<const int> groups() const {
+        return {ids.data() + playerCount, static_cast<size_t>(groupCount)};
+    }
+};
+
+// Free list of notices, grown a block at a time; released notices are reused, so a steady 
+// stream of matches allocates nothing. Notices may be released from any thread. 
+class NoticePool {
+public: 
+    static constexpr int BlockSize = 256; 
+
+    NoticePool() = default; 
+    NoticePool(const NoticePool&) = delete; 
+    NoticePool& operator=(const NoticePool&) = delete; 
+
+    MatchNotice* take() {
+        std::lock_guard<std::mutex> lock(mtx); 
+        if (freeList == nullptr) {
+            blocks.push_back(std::make_unique<MatchNotice[]>(BlockSize)); 
+            for (int i = BlockSize - 1; i >= 0; --i) {
+                MatchNotice& notice = blocks.back()[i]; 
+                notice.pool = this; 
+                notice.nextFree = freeList; 
+                freeList = &notice;
+            }
+        }
+        MatchNotice* notice = freeList; 
+        freeList = notice->nextFree; 
+        return notice;
+    }
+
+    void release(MatchNotice* notice) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        notice->nextFree = freeList; 
+        freeList = notice;
+    }
+
+private: 
+    std::mutex mtx; 
+    MatchNotice* freeList = nullptr; 
+    std::vector<std::unique_ptr<MatchNotice[]>> blocks;
+};
+
+// Counted reference to a MatchNotice (intrusive, so copies never allocate) 
+class NoticeRef {
+public: 
+    NoticeRef() = default; 
+
+    explicit NoticeRef(MatchNotice* notice) : notice(notice) {
+        if (notice != nullptr) {
+            notice->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    NoticeRef(const NoticeRef& other) : NoticeRef(other.notice) {}
+
+    NoticeRef(NoticeRef&& other) noexcept : notice(std::exchange(other.notice, nullptr)) {}
+
+    NoticeRef& operator=(NoticeRef other) noexcept {
+        std::swap(notice, other.notice); 
+        return *this;
+    }
+
+    ~NoticeRef() {
+        reset();
+    }
+
+    void reset() {
+        if (notice != nullptr && notice->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            notice->pool->release(notice);
+        }
+        notice = nullptr;
+    }
+
+    const MatchNotice* operator->() const {
+        return notice;
+    }
+
+    const MatchNotice& operator*() const {
+        return *notice;
+    }
+
+    explicit operator bool() const {
+        return notice != nullptr;
+    }
+
+private: 
+    MatchNotice* notice = nullptr;
+};
+
+// Ready-check settings: a formed party holds a reserved instance until every player accepts 
+struct ReadyCheckPolicy {
+    bool enabled = false; 
+    int timeoutMs = 10000; 
+    double simulatedAcceptRate = -1.0; // >= 0: players accept at formation with this probability, else stay silent 
+};
+
+// Settings that can change while the system runs. Readers copy the current version and a change 
+// publishes a whole new one, so a dungeon or ready check always sees one consistent set of values 
+// and matching never waits for a writer. 
+struct RuntimeConfig {
+    static constexpr int MaxClearTimeSeconds = 24 * 60 * 60; 
+
+    int minTime; 
+    int maxTime; 
+    ReadyCheckPolicy readyCheck; 
+    BackfillPolicy backfill; 
+
+    // Clear times ordered and at most a day, a positive ready-check timeout, probabilities in [0, 1] 
+    // (a negative simulated accept rate means no simulated answers) 
+    bool valid() const {
+        return minTime >= 0 && minTime <= maxTime && maxTime <= MaxClearTimeSeconds && readyCheck.timeoutMs > 0 && 
+               readyCheck.simulatedAcceptRate <= 1.0 && !std::isnan(readyCheck.simulatedAcceptRate) && 
+               backfill.leaveRate >= 0.0 && backfill.leaveRate <= 1.0;
+    }
+};
+
+// What stop() does with dungeons already running: let them run out their timers, or end them now 
+enum class StopMode { FinishInFlight, Abort };
+
+class LFGSystem {
+    friend struct LFGBenchmark;
+    friend struct LFGSelfTest;
+    friend struct LFGReplay;
+
+
+private: 
+    // Synchronization primitives 
+    std::mutex mtx; 
+    std::condition_variable cv; 
+    std::mutex cout_mtx;
+
+    // Player queues, indexed by Role. Cancelled players stay as tombstones until popped. 
+    std::array<TieredQueue, RoleCount> roleQueues; 
+
+    // Flex player queues, indexed by role mask (only multi-role masks are used) 
+    std::array<TieredQueue, RoleMaskCount> flexQueues; 
+
+    // A lower tier's head gains one tier of priority per agingStep waited, so it cannot starve 
+    int64_t agingStepNs = 30'000'000'000; 
+    std::array<LatencyHistogram, TierCount> tierWait; 
+
+    // Live (not cancelled) players per queue, indexed by role mask; cancel updates these without mtx 
+    std::array<std::atomic<int>, RoleMaskCount> liveQueued{}; 
+    std::atomic<int> flexQueued{0}; 
+
+    // Players per primary role as if flex players were locked to it, to measure what flex adds 
+    std::array<std::atomic<int>, RoleCount> rigidQueued{}; 
+
+    // Match notices; declared early so it outlives every member holding a NoticeRef 
+    NoticePool notices; 
+    uint64_t nextNoticeSequence = 0; 
+
+    // Optional memory-mapped queue state; declared before the player table, which may point into it 
+    StateFile stateFile; 
+    bool stateAttached = false; 
+
+    // Player ids handed out by the enqueue functions 
+    PlayerTable players; 
+    int nextPlayerId = 0; 
+
+    // Lock-free per-queue statistics (indexed by role mask) for position and wait queries 
+    struct QueueStats {
+        std::array<std::atomic<uint64_t>, TierCount> tail{};        // tickets issued per tier 
+        std::array<std::atomic<uint64_t>, TierCount> tierHead{};    // entries popped per tier, tombstones included 
+        std::array<std::atomic<int64_t>, TierCount> tombstones{};   // cancelled entries still queued per tier 
+        std::atomic<uint64_t> head{0};       // players dequeued 
+        std::atomic<double> rate{0.0};       // smoothed players dequeued per second 
+        uint64_t sampledHead = 0;            // guarded by rateRefresh 
+    };
+    std::array<QueueStats, RoleMaskCount> queueStats; 
+    std::atomic_flag rateRefresh = ATOMIC_FLAG_INIT; 
+    std::atomic<int64_t> rateSampledAt{0}; 
+
+    // Pre-made group queues, indexed by role shape, with a bitmask of non-empty shapes 
+    struct Group {
+        int id; 
+        std::array<int, RoleCount> shape; 
+        int64_t enqueuedAt;   // steady clock, nanoseconds 
+    };
+    std::array<RingQueue<Group>, ShapeCount> groupQueues; 
+    std::array<uint64_t, ShapeWords> nonEmptyShapes{}; 
+    int groupsQueued = 0; 
+    int groupPlayersQueued = 0; 
+    int nextGroupId = 1; 
+
+    // Groups, solo players and flex players selected for one party 
+    struct PartyPlan {
+        int groupCount = 0; 
+        std::array<int, MaxGroupsPerParty> shapes{}; 
+        std::array<int, RoleCount> open{}; 
+        std::array<int, RoleCount> solos{}; 
+        std::array<int, RoleMaskCount> flex{}; 
+    };
+
+    // Members of a claimed party 
+    struct FormedParty {
+        std::array<int, MaxPartySize> players; 
+        int playerCount = 0; 
+        std::array<Group, MaxGroupsPerParty> groups; 
+        int groupCount = 0; 
+        int64_t formedAt = 0;   // steady clock, nanoseconds 
+    };
+
+    // A ready check in progress, held by its reserved instance (an instance has at most one). The 
+    // id carries the instance in its low bits, so answers and deadlines find it without a map; the 
+    // deadlines sit in a min-heap. 
+    enum Response : uint8_t { Pending, Accepted, Declined };
+    struct ReadyCheck {
+        int id = -1;         // -1 while no check is open 
+        int instanceId; 
+        FormedParty party; 
+        NoticeRef notice; 
+        std::array<Response, MaxPartySize> responses; 
+        int pending; 
+    };
+    static constexpr int ReadyCheckInstanceBits = 10; 
+    static_assert(MaxInstanceCount <= 1 << ReadyCheckInstanceBits); 
+    using Deadline = std::pair<std::chrono::steady_clock::time_point, int>; 
+    int openReadyChecks = 0; 
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> readyDeadlines; 
+    std::condition_variable timerCv; 
+    std::thread timerThread; 
+    int nextReadyCheckId = 0; 
+
+    // Optional binary trace of this session 
+    std::unique_ptr<TraceRecorder> trace; 
+    std::unique_ptr<TimelineTracer> timeline; 
+
+    // Optional durable log of party assignments and completions 
+    std::unique_ptr<WriteAheadLog> wal; 
+
+    // Called for every party that starts, with mtx held (must not call back into the system) 
+    std::function<void(const NoticeRef& notice)> matchListener; 
+
+    // Exported metrics, optionally dumped to a file on an interval 
+    MetricsRegistry metrics; 
+    std::string metricsPath; 
+    std::chrono::milliseconds metricsInterval{1000}; 
+    std::condition_variable metricsCv; 
+    std::thread metricsThread; 
+
+    // Autoscaling state (guarded by mtx) 
+    AutoscalePolicy autoscalePolicy; 
+    std::condition_variable autoscaleCv; 
+    std::thread autoscaleThread; 
+    std::atomic<int> liveInstances{0};   // started and not retiring 
+    int scaleUps = 0; 
+    int scaleDowns = 0; 
+    int peakInstances = 0; 
+    double instanceSeconds = 0.0;        // live instances integrated over time 
+    double autoscaledSeconds = 0.0; 
+    double recoveryMs = 0.0; 
+    // Live instances per party template, rebuilt by every sample; kept so sampling doesn't allocate 
+    struct TemplateDemand {
+        const PartyTemplate* party; 
+        int idle; 
+        int backlog;     // parties of this template the queues could fill 
+    };
+    std::vector<TemplateDemand> templateDemand; 
+
+    // Backfill lane: single-role replacements for running instances, served before new parties 
+    struct BackfillRequest {
+        int id; 
+        int instanceId; 
+        std::chrono::steady_clock::time_point requested;
+    };
+    std::array<RingQueue<BackfillRequest>, RoleCount> backfillQueues; 
+    int pendingBackfills = 0; 
+    int nextBackfillId = 0; 
+    LatencyHistogram backfillLatency; 
+
+    // Party latency by stage (guarded by mtx). Queued and end to end are per queue entry (solo 
+    // player or group); starting covers the ready check, WAL durability and the hand-off to the 
+    // instance thread; running is the dungeon itself. 
+    enum Stage { StageQueued, StageStarting, StageRunning, StageEndToEnd, StageCount }; 
+    static constexpr const char* stageNames[StageCount] = {"Enqueue -> formed", "Formed -> started", 
+                                                           "Started -> completed", "Enqueue -> started"}; 
+    std::array<LatencyHistogram, StageCount> stageLatency; 
+    int backfillsAbandoned = 0; 
+
+    // Instance management 
+    enum InstanceStatus : uint8_t { InstanceEmpty, InstanceReady, InstanceActive, InstanceRetired }; 
+    static constexpr const char* instanceStatusNames[] = {"empty", "ready", "active", "retired"}; 
+
+    struct Instance {
+        int id; 
+        const PartyTemplate* party; 
+        InstanceStatus status; 
+        int partiesServed; 
+        int totalTimeServed; 
+        bool active; 
+        bool reserved = false;   // holding a party through its ready check 
+        bool confirmed = false;  // ready check passed, dungeon not started yet 
+        int plannedTime = 0;     // deterministic mode: dungeon time drawn when the party was claimed 
+        uint64_t virtualFreeAt = 0;   // deterministic mode: virtual time the last party handed out ends 
+        uint64_t walLsn = 0;     // WAL entry that must be durable before the dungeon starts 
+        NoticeRef notice;        // party currently assigned, for its stage timestamps 
+        ReadyCheck readyCheck;   // open while reserved 
+        std::mt19937 partyGen;   // this instance's draws; reseeded per party in deterministic mode 
+        std::atomic<bool> retiring{false};   // autoscaler asked the thread to exit 
+        std::atomic<bool> retired{false};    // thread has exited and can be joined at once 
+        std::atomic<bool> draining{false};   // takes no new parties 
+        std::thread thread;
+
+        Instance(int i, const PartyTemplate* p) : id(i), party(p), status(InstanceEmpty), partiesServed(0), totalTimeServed(0), active(false) {} 
+    }; 
+
+    // Instances never move once added, so threads keep using theirs while the autoscaler adds more 
+    StableList<Instance, MaxInstanceCount> instances; 
+    // std::vector<std::thread> instanceThreads; 
+
+    // Statistics 
+    std::atomic<int> totalPartiesFormed{0}; 
+    std::atomic<int> groupsPlaced{0}; 
+    std::atomic<int> flexPlayersPlaced{0}; 
+    std::atomic<int> flexExtraParties{0}; 
+    std::atomic<int> readyChecksPassed{0}; 
+    std::atomic<int> readyChecksFailed{0}; 
+    std::atomic<int> readyCheckUnready{0}; 
+    std::atomic<bool> running{true}; 
+    std::atomic<int> instancesWaiting{0};
+    std::atomic<int> activeInstances{0}; 
+    std::atomic<int> dungeonsCompleted{0}; 
+    std::atomic<int> dungeonSecondsCompleted{0}; 
+    std::atomic<int> dungeonsAborted{0}; 
+
+    // Dungeon runs and worker backoffs sleep on sleepCv so stop() can wake them 
+    std::mutex sleepMtx; 
+    std::condition_variable sleepCv; 
+    std::atomic<bool> aborting{false}; 
+    std::mutex stopMtx; 
+    bool stopped = false;   // stop() has run (guarded by stopMtx) 
+
+    // Configuration 
+    int maxInstances; 
+    // Role slots summed over live instances. Changed under mtx; atomic because the lock-free 
+    // queue estimate reads it 
+    std::array<std::atomic<int>, RoleCount> instanceSlots{}; 
+    // Runtime settings in a small ring of slots. A reader pins the current slot with its reader 
+    // count while it copies it; a writer fills a slot nobody is reading and then publishes it, so 
+    // memory stays fixed and readers never wait for a writer. 
+    struct ConfigSlot {
+        RuntimeConfig config{}; 
+        std::atomic<int> readers{0};
+    };
+    static constexpr int ConfigSlots = 8; 
+    std::mutex configMtx; 
+    mutable std::array<ConfigSlot, ConfigSlots> configSlots; 
+    std::atomic<ConfigSlot*> config{nullptr}; 
+    bool logging = true;
+
+    // Random number generation 
+    std::random_device rd; 
+    std::mt19937 gen; 
+
+    // Deterministic mode (guarded by mtx): each party goes to the instance that would be free first 
+    // if every dungeon took exactly its drawn time, ties going by a seeded order, skipping instances 
+    // whose template can't be filled. Each party's duration and simulated events come from a stream 
+    // seeded by a count of deterministic parties, so no wall-clock timing feeds into either 
+    bool deterministic = false; 
+    uint64_t deterministicSeed = 0; 
+    std::vector<int> turnOrder;           // tie-break order, shuffled by the seed 
+    uint64_t deterministicParties = 0; 
+    uint64_t virtualClock = 0;            // virtual start time of the last party handed out 
+
+    // Write the current time as HH:MM:SS.mmm into out (no allocation) 
+    static void format_timestamp(char (&out)[16]) {
+        auto now = std::chrono::system_clock::now(); 
+        std::time_t in_time_t = std::chrono::system_clock::to_time_t(now); 
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now.time_since_epoch()) % 1000; 
+
+        std::tm local{}; 
+#ifdef _WIN32
+        localtime_s(&local, &in_time_t); 
+#else
+        localtime_r(&in_time_t, &local); 
+#endif
+        std::snprintf(out, sizeof(out), "%02d:%02d:%02d.%03d", local.tm_hour, local.tm_min, local.tm_sec, 
+                      static_cast<int>(ms.count()));
+    }
+
+    static int64_t steady_now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Queue that holds players for a role mask 
+    TieredQueue& queueFor(int roleMask) {
+        return std::has_single_bit(static_cast<unsigned>(roleMask)) 
+            ? roleQueues[std::countr_zero(static_cast<unsigned>(roleMask))] 
+            : flexQueues[roleMask];
+    }
+
+    // Assign ids, tickets and queue slots to a run of players sharing a queue and tier, splicing 
+    // them into the queue at once (mtx must be held; publish afterwards). Returns the first id. 
+    int enqueueRun(int roleMask, int tier, int count, int64_t now) {
+        int firstId = nextPlayerId; 
+        // Writers are serialized by mtx, so plain stores suffice (no locked read-modify-write) 
+        auto& tail = queueStats[roleMask].tail[tier]; 
+        uint64_t ticket = tail.load(std::memory_order_relaxed); 
+        for (int i = 0; i < count; ++i) {
+            PlayerTable::Record* record = players.prepare(firstId + i); 
+            record->state.store(PlayerTable::Queued, std::memory_order_relaxed); 
+            record->readyCheck = -1; 
+            record->roleMask = static_cast<uint8_t>(roleMask); 
+            record->tier = static_cast<uint8_t>(tier); 
+            record->enqueuedAt = now; 
+            record->ticket = ticket + i;
+        }
+        tail.store(ticket + count, std::memory_order_relaxed); 
+        nextPlayerId += count; 
+        queueFor(roleMask).append_range(firstId, count, tier); 
+
+        if (trace) {
+            trace->record(TraceEnqueue, -1, firstId, count, roleMask, tier);
+        }
+
+        liveQueued[roleMask].fetch_add(count, std::memory_order_relaxed); 
+        rigidQueued[std::countr_zero(static_cast<unsigned>(roleMask))].fetch_add(count, std::memory_order_relaxed); 
+        if (!std::has_single_bit(static_cast<unsigned>(roleMask))) {
+            flexQueued.fetch_add(count, std::memory_order_relaxed);
+        }
+        return firstId;
+    }
+
+    // Wake instances after an enqueue (mtx must be held) 
+    void notifyEnqueued() {
+        if (pendingBackfills != 0) {
+            serveBackfills();
+        }
+        cv.notify_all();
+    }
+
+    // Tier to dequeue from next: highest tier plus aging credit of its head, older head on ties (mtx must be held) 
+    int pickTier(const TieredQueue& queue, int64_t now) {
+        if (queue.standardOnly()) {
+            return Standard;
+        }
+
+        int best = -1; 
+        int64_t bestScore = 0, bestEnqueued = 0; 
+        for (int t = 0; t < TierCount; ++t) {
+            if (queue.empty(t)) {
+                continue;
+            }
+            int64_t enqueued = players.at(queue.front(t))->enqueuedAt; 
+            int64_t score = t + (now - enqueued) / agingStepNs; 
+            if (best < 0 || score > bestScore || (score == bestScore && enqueued < bestEnqueued)) {
+                best = t; 
+                bestScore = score; 
+                bestEnqueued = enqueued;
+            }
+        }
+        return best;
+    }
+
+    // Record a matched player's time in queue under their tier (mtx must be held) 
+    void recordWait(int playerId, int64_t now, MetricsRegistry::Shard& shard) {
+        const PlayerTable::Record* record = players.at(playerId); 
+        tierWait[record->tier].record(now - record->enqueuedAt); 
+        shard.recordWait(now - record->enqueuedAt);
+    }
+
+    // Advance a queue's dequeue counter (mtx must be held) 
+    void advanceHead(int roleMask, uint64_t count) {
+        auto& head = queueStats[roleMask].head; 
+        head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Move a tier's pop counter by delta; claims put back at the front move it back (mtx must be held) 
+    void bumpTierHead(int roleMask, int tier, int64_t delta) {
+        auto& head = queueStats[roleMask].tierHead[tier]; 
+        head.store(head.load(std::memory_order_relaxed) + delta, std::memory_order_release);
+    }
+
+    // Claim up to count live players from the front of a queue, dropping tombstones (mtx must be held). 
+    // Returns the number claimed; popped counts every entry removed, tombstones included. 
+    int claimFromQueue(int roleMask, int count, int* claimed, uint64_t& popped, int64_t now) {
+        auto& queue = queueFor(roleMask); 
+        int got = 0; 
+        while (got < count && !queue.empty()) {
+            int tier = pickTier(queue, now); 
+            int id = queue.front(tier); 
+            queue.pop_front(tier); 
+            popped++; 
+            bumpTierHead(roleMask, tier, 1); 
+
+            uint8_t expected = PlayerTable::Queued; 
+            if (players.at(id)->state.compare_exchange_strong(expected, PlayerTable::Claimed, std::memory_order_acq_rel)) {
+                claimed[got++] = id;
+            } else {
+                queueStats[roleMask].tombstones[tier].fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        return got;
+    }
+
+    // Refresh the smoothed dequeue rates at most once per second; called off the matching path 
+    void refreshRates() {
+        int64_t now = steady_now_ns(); 
+        int64_t last = rateSampledAt.load(std::memory_order_relaxed); 
+        if (now - last < 1'000'000'000 || rateRefresh.test_and_set(std::memory_order_acquire)) {
+            return;
+        }
+
+        double seconds = (now - last) / 1e9; 
+        for (auto& stats : queueStats) {
+            uint64_t head = stats.head.load(std::memory_order_acquire); 
+            double sample = (head - stats.sampledHead) / seconds; 
+            stats.sampledHead = head; 
+            double previous = stats.rate.load(std::memory_order_relaxed); 
+            stats.rate.store(last == 0 ? sample : 0.5 * previous + 0.5 * sample, std::memory_order_relaxed);
+        }
+        rateSampledAt.store(now, std::memory_order_relaxed); 
+        rateRefresh.clear(std::memory_order_release);
+    }
+
+    // Synchronized output function 
+    void synchronized_print(std::string_view message) {
+        if (!logging) {
+            return;
+        }
+        char timestamp[16]; 
+        format_timestamp(timestamp); 
+        std::lock_guard<std::mutex> cout_lock(cout_mtx); 
+        // std::cout << message << std::endl; 
+        std::cout << "[" << timestamp << "] " << message << std::endl;
+    }
+
+    // printf-style log line formatted into a stack buffer 
+    template <typename... Args>
+    void logf(const char* format, Args... args) {
+        if (!logging) {
+            return;
+        }
+        char line[256]; 
+        int length = std::snprintf(line, sizeof(line), format, args...); 
+        synchronized_print(std::string_view(line, std::clamp<int>(length, 0, sizeof(line) - 1)));
+    }
+
+public: 
+    LFGSystem(int n, int minTime, int maxTime, const PartyTemplate& party = DungeonParty) 
+        : maxInstances(0), gen(rd()) {
+        publishConfig(RuntimeConfig{minTime, maxTime, {}, {}});
+        addInstances(n, party);
+        rateSampledAt.store(steady_now_ns());
+    } 
+
+    ~LFGSystem() {
+        stop();
+    } 
+
+    // Add instances serving the given party template (call before start) 
+    void addInstances(int count, const PartyTemplate& party) {
+        for (int i = 0; i < count && instances.emplace_back(maxInstances + 1, &party) != nullptr; ++i) {
+            instances[maxInstances].partyGen.seed(gen()); 
+            maxInstances++; 
+            for (int r = 0; r < RoleCount; ++r) {
+                instanceSlots[r].fetch_add(party.slots[r], std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Grow and shrink the pool with demand (call before start). The instances added so far are 
+    // the starting pool; new ones serve the template whose parties most outnumber its idle instances. 
+    // Not combined with deterministic mode, whose turn order covers a fixed pool. 
+    bool setAutoscale(const AutoscalePolicy& policy) {
+        if (deterministic || policy.minInstances < 1 || policy.maxInstances < policy.minInstances) {
+            return false;
+        }
+        autoscalePolicy = policy; 
+        return true;
+    }
+
+    // Configure ready checks (call before start) 
+    void setReadyCheck(const ReadyCheckPolicy& policy) {
+        RuntimeConfig next = settings(); 
+        next.readyCheck = policy; 
+        publishConfig(next);
+    }
+
+    // Configure simulated mid-dungeon departures (call before start) 
+    void setBackfill(const BackfillPolicy& policy) {
+        RuntimeConfig next = settings(); 
+        next.backfill = policy; 
+        publishConfig(next);
+    }
+
+    // Record enqueues, cancellations, formations and dungeon runs to a binary trace file 
+    // (call after the instances are added and before start); returns false if the file can't be created 
+    bool startTrace(const std::string& path) {
+        RuntimeConfig current = settings(); 
+        std::vector<const PartyTemplate*> parties(maxInstances); 
+        for (int i = 0; i < maxInstances; ++i) {
+            parties[i] = instances[i].party;
+        }
+        trace = std::make_unique<TraceRecorder>(path, parties, current.minTime, current.maxTime); 
+        if (!trace->ok()) {
+            trace.reset(); 
+            return false;
+        }
+        return true;
+    }
+
+    // Make instance assignment and dungeon durations a function of seed, so runs with the same 
+    // input produce the same per-instance distribution (call after the instances are added and 
+    // before start). Instances still run on their own threads; only the order parties are handed 
+    // out in is fixed, so an instance whose turn it is may keep the others waiting until its 
+    // dungeon ends. Returns false if autoscaling is on: the turn order covers a fixed pool. 
+    bool setDeterministic(uint64_t seed) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        if (autoscalePolicy.enabled) {
+            return false;
+        }
+        deterministic = true; 
+        deterministicSeed = seed; 
+        deterministicParties = 0; 
+        virtualClock = 0; 
+        turnOrder.resize(instances.size()); 
+        std::iota(turnOrder.begin(), turnOrder.end(), 0); 
+        // Fisher-Yates with splitmix draws, identical on every platform 
+        for (size_t i = turnOrder.size(); i > 1; --i) {
+            std::swap(turnOrder[i - 1], turnOrder[mixSeed(seed + i) % i]);
+        }
+        return true;
+    }
+
+    // Record instance busy and idle spans, lock waits and formations as Chrome trace JSON, 
+    // written to path by stop() (call before start) 
+    void startTimeline(const std::string& path) {
+        timeline = std::make_unique<TimelineTracer>(path);
+    }
+
+    // Lock mtx; with a timeline, time spent blocked on it is recorded as a lock wait 
+    std::unique_lock<std::mutex> lockTimed() {
+        if (!timeline) {
+            return std::unique_lock<std::mutex>(mtx);
+        }
+        std::unique_lock<std::mutex> lock(mtx, std::try_to_lock); 
+        if (!lock.owns_lock()) {
+            int64_t begin = timeline->now(); 
+            lock.lock(); 
+            timeline->span(TimelineLockWait, begin, timeline->now());
+        }
+        return lock;
+    }
+
+    // Keep queued players and instance totals in a memory-mapped file (call before adding players 
+    // or starting). An existing file is recovered: its queued players are put back in their queues 
+    // with their ids. Returns false if the file can't be mapped. 
+    bool attachState(const std::string& path, int capacity = 1 << 22) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        bool recovered = false; 
+        if (stateAttached || nextPlayerId != 0 || !stateFile.open(path, capacity, recovered)) {
+            return false;
+        }
+        stateAttached = true; 
+
+        StateHeader* header = stateFile.header(); 
+        int64_t clockOffset = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() - steady_now_ns(); 
+        int64_t clockShift = recovered ? header->clockOffsetNs - clockOffset : 0; 
+        header->clockOffsetNs = clockOffset; 
+        players.attach(stateFile.records(), header->capacity, &header->playerCount); 
+
+        if (!recovered) {
+            header->instances = maxInstances; 
+            return true;
+        }
+
+        // Rebuild the queues from the records, splicing runs of consecutive ids 
+        auto begin = std::chrono::steady_clock::now(); 
+        int count = header->playerCount.load(std::memory_order_acquire); 
+        std::array<std::array<uint64_t, TierCount>, RoleMaskCount> minTicket, maxTicket{}; 
+        for (auto& tiers : minTicket) {
+            tiers.fill(UINT64_MAX);
+        }
+        std::array<int, RoleMaskCount> live{}; 
+        int runStart = 0, runLength = 0, runMask = 0, runTier = 0; 
+        auto flushRun = [&]() {
+            if (runLength > 0) {
+                queueFor(runMask).append_range(runStart, runLength, runTier); 
+                live[runMask] += runLength;
+            }
+            runLength = 0;
+        };
+
+        for (int id = 0; id < count; ++id) {
+            PlayerTable::Record* record = players.at(id); 
+            uint8_t state = record->state.load(std::memory_order_relaxed); 
+            int roleMask = record->roleMask; 
+            if (roleMask <= 0 || roleMask >= RoleMaskCount || record->tier >= TierCount) {
+                record->state.store(PlayerTable::Cancelled, std::memory_order_relaxed); 
+                continue;
+            }
+            uint64_t& maxTier = maxTicket[roleMask][record->tier]; 
+            maxTier = std::max(maxTier, record->ticket + 1); 
+            record->readyCheck = -1; 
+            record->enqueuedAt += clockShift; 
+
+            // A claim the crash interrupted never completed 
+            if (state == PlayerTable::Claimed) {
+                record->state.store(PlayerTable::Queued, std::memory_order_relaxed); 
+                state = PlayerTable::Queued;
+            }
+            if (state != PlayerTable::Queued) {
+                continue;
+            }
+
+            minTicket[roleMask][record->tier] = std::min(minTicket[roleMask][record->tier], record->ticket); 
+            if (runLength > 0 && (id != runStart + runLength || roleMask != runMask || record->tier != runTier)) {
+                flushRun();
+            }
+            if (runLength == 0) {
+                runStart = id; 
+                runMask = roleMask; 
+                runTier = record->tier;
+            }
+            runLength++;
+        }
+        flushRun(); 
+
+        int queued = 0; 
+        for (int mask = 1; mask < RoleMaskCount; ++mask) {
+            for (int t = 0; t < TierCount; ++t) {
+                queueStats[mask].tail[t].store(maxTicket[mask][t]); 
+                queueStats[mask].tierHead[t].store(std::min(minTicket[mask][t], maxTicket[mask][t]));
+            }
+            liveQueued[mask].store(live[mask]); 
+            rigidQueued[std::countr_zero(static_cast<unsigned>(mask))] += live[mask]; 
+            if (!std::has_single_bit(static_cast<unsigned>(mask))) {
+                flexQueued += live[mask];
+            }
+            queued += live[mask];
+        }
+        nextPlayerId = count; 
+        players.publish(count); 
+
+        for (int i = 0; i < std::min({maxInstances, header->instances, StateHeader::MaxInstances}); ++i) {
+            instances[i].partiesServed = header->instanceStats[i].partiesServed; 
+            instances[i].totalTimeServed = header->instanceStats[i].totalTimeServed;
+        }
+        header->instances = maxInstances; 
+
+        recoveryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count(); 
+        std::ostringstream oss; 
+        oss << "Recovered " << queued << " queued players (" << count << " records) from " << path << " in " 
+            << std::fixed << std::setprecision(2) << recoveryMs << "ms"; 
+        synchronized_print(oss.str()); 
+        return true;
+    }
+
+    // Log every party assignment and dungeon completion to an append-only WAL with group commit. 
+    // Instances wait for their assignment to be durable before starting the dungeon. 
+    // useRing writes and syncs each batch through io_uring where available. 
+    bool openWal(const std::string& path, bool useRing = false) {
+        auto log = std::make_unique<WriteAheadLog>(); 
+        if (!log->open(path, useRing)) {
+            return false;
+        }
+        wal = std::move(log); 
+        return true;
+    }
+
+    // Write metrics to path every intervalMs (JSON if the path ends in .json, else Prometheus 
+    // text). The file is replaced atomically, so scrapers never see a partial dump. 
+    void startMetricsDump(const std::string& path, int intervalMs) {
+        metricsPath = path; 
+        metricsInterval = std::chrono::milliseconds(std::max(intervalMs, 10)); 
+        metricsThread = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(mtx); 
+            while (!metricsCv.wait_for(lock, metricsInterval, [this] { return !running.load(); })) {
+                lock.unlock(); 
+                dumpMetrics(); 
+                lock.lock();
+            }
+        });
+    }
+
+    // Write one metrics dump now 
+    bool dumpMetrics() {
+        bool json = metricsPath.size() >= 5 && metricsPath.compare(metricsPath.size() - 5, 5, ".json") == 0; 
+        std::string temp = metricsPath + ".tmp"; 
+        {
+            std::ofstream out(temp, std::ios::trunc); 
+            if (!out) {
+                return false;
+            }
+            out << exportMetrics(json);
+        }
+        return std::rename(temp.c_str(), metricsPath.c_str()) == 0;
+    }
+
+    // Register a callback for parties starting; it runs with the system's lock held, so it should 
+    // only keep a reference to the notice and return (set before start()) 
+    void setMatchListener(std::function<void(const NoticeRef& notice)> listener) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        matchListener = std::move(listener);
+    }
+
+    // Allocate player records for count more ids up front, so enqueueing them later does not 
+    // touch the heap (queues keep their storage once they have reached their working depth) 
+    void reservePlayers(int count) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        players.reserve(nextPlayerId + count);
+    }
+
+    // Enable or disable console logging 
+    void setLogging(bool enabled) {
+        logging = enabled;
+    }
+
+    // Set how long a lower-tier player waits to gain one tier of priority 
+    void setAging(int stepMs) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        agingStepNs = std::max<int64_t>(stepMs, 1) * 1'000'000;
+    }
+
+    // Add players to queues; ids are consecutive (tanks, then healers, then DPS) starting at the returned id 
+    int addPlayers(int tanks, int healers, int dps, Tier tier = Standard) {
+        std::lock_guard<std::mutex> lock(mtx); 
+
+        int firstId = nextPlayerId; 
+        int64_t now = steady_now_ns(); 
+        const int counts[RoleCount] = {tanks, healers, dps}; 
+        for (int r = 0; r < RoleCount; ++r) {
+            if (counts[r] > 0) {
+                enqueueRun(roleBit(r), tier, counts[r], now);
+            }
+        }
+        players.publish(nextPlayerId); 
+
+        logf("Added %d tanks, %d healers, %d DPS to queue.", tanks, healers, dps);
+        notifyEnqueued(); 
+        return firstId;
+    }
+
+    // Add players that accept any role in roleMask (lowest set role is their primary); returns the first id or -1 
+    int addFlexPlayers(int roleMask, int count, Tier tier = Standard) {
+        if (roleMask <= 0 || roleMask >= RoleMaskCount || count <= 0) {
+            return -1;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx); 
+        int firstId = enqueueRun(roleMask, tier, count, steady_now_ns()); 
+        players.publish(nextPlayerId); 
+
+        // Role list such as "Tank/Healer" built in place, so logging stays allocation-free 
+        char roles[32] = ""; 
+        for (int r = 0, length = 0; r < RoleCount; ++r) {
+            if (roleMask & roleBit(r)) {
+                length += std::snprintf(roles + length, sizeof(roles) - length, "%s%s", length > 0 ? "/" : "", roleNames[r]);
+            }
+        }
+        logf("Added %d flex players (%s) to queue.", count, roles);
+        notifyEnqueued(); 
+        return firstId;
+    }
+
+    // Bulk enqueue under one lock with one log line and one wakeup. Consecutive requests with the 
+    // same roles and tier (e.g. a batch pre-sorted per role) are spliced into their queue as one run. 
+    // Ids are consecutive in batch order from the returned id; invalid role masks are skipped. 
+    int addPlayers(std::span<const PlayerRequest> batch) {
+        std::lock_guard<std::mutex> lock(mtx); 
+
+        int firstId = nextPlayerId; 
+        int64_t now = steady_now_ns(); 
+        std::array<int, RoleMaskCount> added{}; 
+        for (size_t i = 0; i < batch.size();) {
+            size_t end = i + 1; 
+            while (end < batch.size() && batch[end].roleMask == batch[i].roleMask && batch[end].tier == batch[i].tier) {
+                end++;
+            }
+            int roleMask = batch[i].roleMask; 
+            if (roleMask > 0 && roleMask < RoleMaskCount && batch[i].tier < TierCount) {
+                enqueueRun(roleMask, batch[i].tier, static_cast<int>(end - i), now); 
+                added[roleMask] += static_cast<int>(end - i);
+            }
+            i = end;
+        }
+        players.publish(nextPlayerId); 
+
+        int flex = 0; 
+        for (int mask : FlexMasks) {
+            flex += added[mask];
+        }
+        logf("Added batch of %d players (%d tanks, %d healers, %d DPS, %d flex) to queue.", nextPlayerId - firstId, 
+             added[roleBit(Tank)], added[roleBit(Healer)], added[roleBit(DPS)], flex);
+        notifyEnqueued(); 
+        return firstId;
+    }
+
+    // Remove a player from the queue in O(1) by tombstoning it; lock-free. Returns false if the 
+    // player was already matched or cancelled. A cancelled player is never placed into a party. 
+    bool cancelPlayer(int playerId) {
+        PlayerTable::Record* record = players.find(playerId); 
+        if (record == nullptr) {
+            return false;
+        }
+
+        for (;;) {
+            uint8_t expected = PlayerTable::Queued; 
+            if (record->state.compare_exchange_strong(expected, PlayerTable::Cancelled, std::memory_order_acq_rel)) {
+                break;
+            }
+            if (expected != PlayerTable::Claimed) {
+                return false;
+            }
+            // The matcher is mid-claim; it resolves to Matched or back to Queued within the critical section 
+            std::this_thread::yield();
+        }
+
+        int roleMask = record->roleMask; 
+        liveQueued[roleMask].fetch_sub(1, std::memory_order_relaxed); 
+        queueStats[roleMask].tombstones[record->tier].fetch_add(1, std::memory_order_relaxed); 
+        rigidQueued[std::countr_zero(static_cast<unsigned>(roleMask))].fetch_sub(1, std::memory_order_relaxed); 
+        if (!std::has_single_bit(static_cast<unsigned>(roleMask))) {
+            flexQueued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        metrics.local().add(MetricCancellations, 1); 
+        if (trace) {
+            trace->record(TraceCancel, -1, playerId, 0, roleMask);
+        }
+        return true;
+    }
+
+    // Position and estimated time-to-match for a player; lock-free, safe to poll heavily 
+    QueueEstimate getQueueEstimate(int playerId) const {
+        QueueEstimate estimate; 
+        const PlayerTable::Record* record = players.find(playerId); 
+        if (record == nullptr || record->state.load(std::memory_order_acquire) != PlayerTable::Queued) {
+            return estimate;
+        }
+
+        const QueueStats& stats = queueStats[record->roleMask]; 
+        int tier = record->tier; 
+        uint64_t head = stats.tierHead[tier].load(std::memory_order_acquire); 
+        uint64_t tail = stats.tail[tier].load(std::memory_order_acquire); 
+        estimate.queued = true; 
+        estimate.roleMask = record->roleMask; 
+        // Entries ahead in the player's tier; players returned by a failed ready check sit at the 
+        // front behind the pop counter 
+        long long ahead = record->ticket >= head ? static_cast<long long>(record->ticket - head) : 0; 
+        // Cancelled entries that can't all be behind the player are ahead of them 
+        long long behind = tail > record->ticket ? static_cast<long long>(tail - record->ticket - 1) : 0; 
+        ahead -= std::clamp(stats.tombstones[tier].load(std::memory_order_relaxed) - behind, 0LL, ahead); 
+        // No more live players can be ahead than are queued for these roles 
+        long long queued = liveQueued[record->roleMask].load(std::memory_order_relaxed); 
+        estimate.position = std::clamp(ahead + 1, 1LL, std::max(queued, 1LL)); 
+
+        // Capacity for the player's roles: slots per dungeon over the running mean clear time 
+        int completed = dungeonsCompleted.load(std::memory_order_relaxed); 
+        double meanDungeon; 
+        if (completed > 0) {
+            meanDungeon = static_cast<double>(dungeonSecondsCompleted.load(std::memory_order_relaxed)) / completed;
+        } else {
+            RuntimeConfig current = settings(); 
+            meanDungeon = (current.minTime + current.maxTime) / 2.0;
+        }
+        meanDungeon = std::max(meanDungeon, 0.05); 
+
+        double slots = 0.0, idleSlots = 0.0; 
+        for (int r = 0; r < RoleCount; ++r) {
+            if (record->roleMask & roleBit(r)) {
+                slots += instanceSlots[r].load(std::memory_order_relaxed);
+            }
+        }
+        int active = activeInstances.load(std::memory_order_relaxed), live = liveInstances.load(std::memory_order_relaxed); 
+        idleSlots = live == 0 ? 0.0 : slots * std::max(0, live - active) / live; 
+        double capacityRate = slots / meanDungeon; 
+
+        // Players within the idle instances' slots are matched as soon as the other roles allow 
+        double waiting = std::max(0.0, estimate.position - idleSlots); 
+        if (waiting == 0.0) {
+            estimate.estimatedWaitSeconds = 0.0; 
+            return estimate;
+        }
+        double observedRate = stats.rate.load(std::memory_order_relaxed); 
+        double rate = observedRate > 0.0 ? std::min(observedRate, capacityRate) : (active > 0 ? capacityRate : 0.0); 
+        if (rate > 0.0) {
+            estimate.estimatedWaitSeconds = waiting / rate;
+        }
+        return estimate;
+    }
+
+    // Add a pre-made group that must be placed into the same party; returns the group id or -1 
+    int addGroup(int tanks, int healers, int dps) {
+        int size = tanks + healers + dps; 
+        if (tanks < 0 || healers < 0 || dps < 0 || size < 1 || size > MaxGroupSize) {
+            return -1;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx); 
+        int id = nextGroupId++; 
+        int shape = shapeIndex(tanks, healers, dps); 
+        groupQueues[shape].push_back(Group{id, {tanks, healers, dps}, steady_now_ns()}); 
+        nonEmptyShapes[shape / 64] |= uint64_t{1} << (shape % 64); 
+        groupsQueued++; 
+        groupPlayersQueued += size; 
+        if (trace) {
+            trace->record(TraceGroup, -1, id, shape);
+        }
+
+        logf("Added group %d (%d tanks, %d healers, %d DPS) to queue.", id, tanks, healers, dps);
+        cv.notify_all();
+        return id;
+    }
+
+    // Check if solo queues cover the given slots (no early exit, so the check stays branch-free) 
+    bool solosAvailable(const std::array<int, RoleCount>& slots) {
+        bool ok = true; 
+        for (int r = 0; r < RoleCount; ++r) {
+            ok &= liveQueued[roleBit(r)].load(std::memory_order_relaxed) >= slots[r];
+        }
+        return ok;
+    }
+
+    // Hall's condition: every set of roles' deficit is covered by flex players accepting one of them 
+    static bool flexFeasible(const std::array<int, RoleCount>& deficit, const std::array<int, RoleMaskCount>& available) {
+        for (int roles = 1; roles < RoleMaskCount; ++roles) {
+            int need = 0, have = 0; 
+            for (int r = 0; r < RoleCount; ++r) {
+                need += (roles & roleBit(r)) ? deficit[r] : 0;
+            }
+            for (int mask : FlexMasks) {
+                have += (roles & mask) ? available[mask] : 0;
+            }
+            if (need > have) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Fill the plan's open slots from single-role queues first, then assign flex players (mtx must be held) 
+    bool fillOpenSlots(PartyPlan& plan) {
+        plan.flex = {}; 
+        if (flexQueued == 0) {
+            plan.solos = plan.open; 
+            return solosAvailable(plan.solos);
+        }
+
+        std::array<int, RoleCount> deficit; 
+        for (int r = 0; r < RoleCount; ++r) {
+            plan.solos[r] = std::min(plan.open[r], liveQueued[roleBit(r)].load(std::memory_order_relaxed)); 
+            deficit[r] = plan.open[r] - plan.solos[r];
+        }
+
+        std::array<int, RoleMaskCount> available{}; 
+        for (int mask : FlexMasks) {
+            available[mask] = liveQueued[mask].load(std::memory_order_relaxed);
+        }
+        if (!flexFeasible(deficit, available)) {
+            return false;
+        }
+
+        // Take the least flexible player that keeps the remaining deficit coverable 
+        for (int r = 0; r < RoleCount; ++r) {
+            while (deficit[r] > 0) {
+                for (int mask : FlexMasks) {
+                    if (!(mask & roleBit(r)) || available[mask] == 0) {
+                        continue;
+                    }
+                    available[mask]--; 
+                    deficit[r]--; 
+                    if (flexFeasible(deficit, available)) {
+                        plan.flex[mask]++; 
+                        break;
+                    }
+                    available[mask]++; 
+                    deficit[r]++;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Select groups (oldest fitting shape first), solos and flex players for a party (mtx must be held) 
+    bool planParty(const PartyTemplate& party, PartyPlan& plan) {
+        plan.groupCount = 0; 
+        plan.open = party.slots; 
+        if (groupsQueued == 0) {
+            return fillOpenSlots(plan);
+        }
+
+        while (plan.groupCount < MaxGroupsPerParty) {
+            int best = -1; 
+            for (int w = 0; w < ShapeWords; ++w) {
+                for (uint64_t bits = nonEmptyShapes[w]; bits != 0; bits &= bits - 1) {
+                    int shape = w * 64 + std::countr_zero(bits); 
+                    auto need = shapeOf(shape); 
+                    bool fits = true; 
+                    for (int r = 0; r < RoleCount; ++r) {
+                        fits &= need[r] <= plan.open[r];
+                    }
+                    if (!fits) {
+                        continue;
+                    }
+
+                    // Skip shapes whose queued groups are all already in this plan 
+                    size_t taken = 0; 
+                    for (int g = 0; g < plan.groupCount; ++g) {
+                        taken += plan.shapes[g] == shape;
+                    }
+                    if (taken >= groupQueues[shape].size()) {
+                        continue;
+                    }
+                    // Lower group ids queued earlier; prefer the oldest fitting head 
+                    if (best < 0 || groupQueues[shape].front().id < groupQueues[best].front().id) {
+                        best = shape;
+                    }
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+
+            auto need = shapeOf(best); 
+            for (int r = 0; r < RoleCount; ++r) {
+                plan.open[r] -= need[r];
+            }
+            plan.shapes[plan.groupCount++] = best;
+        }
+        return fillOpenSlots(plan);
+    }
+
+    // Instance due the next party in deterministic mode: the earliest virtual free time among 
+    // instances whose template can be filled, first in turnOrder on a tie, or -1 (mtx must be held). 
+    // Uses only what earlier hand-outs decided, never whether a thread happens to be waiting. 
+    int turnOwner() {
+        int owner = -1; 
+        uint64_t ownerFreeAt = 0; 
+        for (int id : turnOrder) {
+            const Instance& instance = instances[id]; 
+            uint64_t freeAt = std::max(instance.virtualFreeAt, virtualClock); 
+            if ((owner < 0 || freeAt < ownerFreeAt) && !instance.draining.load() && canFormParty(*instance.party)) {
+                owner = id; 
+                ownerFreeAt = freeAt;
+            }
+        }
+        return owner;
+    }
+
+    // Draw a claimed party's dungeon time and event stream from the deterministic party count, 
+    // and move the instance's virtual free time past it (mtx must be held) 
+    void planDeterministic(Instance& instance) {
+        uint64_t draw = mixSeed(deterministicSeed + ++deterministicParties); 
+        RuntimeConfig current = settings(); 
+        // Mapped by hand rather than through a distribution, so it is the same with any standard library 
+        uint64_t span = static_cast<uint64_t>(current.maxTime - current.minTime) + 1; 
+        instance.plannedTime = current.minTime + static_cast<int>(draw % span); 
+        instance.partyGen.seed(static_cast<uint32_t>(draw >> 32)); 
+        virtualClock = std::max(virtualClock, instance.virtualFreeAt); 
+        instance.virtualFreeAt = virtualClock + instance.plannedTime;
+    }
+
+    // Random source for simulated events of the instance's current party. Each instance has its 
+    // own, since dungeon runs draw from it without holding mtx. 
+    std::mt19937& drawsFor(int instanceID) {
+        return instances[instanceID].partyGen;
+    }
+
+    // Check if party can be formed 
+    bool canFormParty(const PartyTemplate& party) { 
+        PartyPlan plan; 
+        return planParty(party, plan);
+    } 
+
+    // Check if any instance's template can be served; drained instances don't count 
+    bool canFormAnyParty() {
+        for (const auto& instance : instances) {
+            if (!instance.draining.load() && canFormParty(*instance.party)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Claim the planned groups, solo and flex players for one party (mtx must be held). Returns 
+    // false, leaving the queues as they were, if cancellations since planning left it short. 
+    bool claimParty(const PartyPlan& plan, FormedParty& formed) {
+        struct Taken {
+            int roleMask; 
+            int first; 
+            int count; 
+            uint64_t popped;
+        };
+        auto& claimed = formed.players; 
+        std::array<Taken, RoleMaskCount> taken; 
+        int takenCount = 0, total = 0; 
+        bool complete = true; 
+        int64_t now = steady_now_ns(); 
+
+        auto take = [&](int roleMask, int count) {
+            Taken& t = taken[takenCount++]; 
+            t = Taken{roleMask, total, 0, 0}; 
+            t.count = claimFromQueue(roleMask, count, claimed.data() + total, t.popped, now); 
+            total += t.count; 
+            complete &= t.count == count;
+        };
+        for (int r = 0; r < RoleCount; ++r) {
+            if (plan.solos[r] > 0) {
+                take(roleBit(r), plan.solos[r]);
+            }
+        }
+        for (int mask : FlexMasks) {
+            if (plan.flex[mask] > 0) {
+                take(mask, plan.flex[mask]);
+            }
+        }
+
+        if (!complete) {
+            // Put the claimed players back at the front in their original order 
+            for (int k = takenCount - 1; k >= 0; --k) {
+                const Taken& t = taken[k]; 
+                auto& queue = queueFor(t.roleMask); 
+                for (int i = t.first + t.count - 1; i >= t.first; --i) {
+                    PlayerTable::Record* record = players.at(claimed[i]); 
+                    record->state.store(PlayerTable::Queued, std::memory_order_release); 
+                    queue.push_front(claimed[i], record->tier); 
+                    bumpTierHead(t.roleMask, record->tier, -1);
+                }
+                advanceHead(t.roleMask, t.popped - t.count);
+            }
+            return false;
+        }
+
+        MetricsRegistry::Shard& shard = metrics.local(); 
+        for (int i = 0; i < total; ++i) {
+            players.at(claimed[i])->state.store(PlayerTable::Matched, std::memory_order_release); 
+            recordWait(claimed[i], now, shard);
+        }
+        formed.playerCount = total; 
+        formed.formedAt = now; 
+        for (int k = 0; k < takenCount; ++k) {
+            liveQueued[taken[k].roleMask].fetch_sub(taken[k].count, std::memory_order_relaxed); 
+            advanceHead(taken[k].roleMask, taken[k].popped);
+        }
+
+        if (plan.groupCount > 0) {
+            groupsPlaced += plan.groupCount;
+        }
+        formed.groupCount = plan.groupCount; 
+        for (int g = 0; g < plan.groupCount; ++g) {
+            int shape = plan.shapes[g]; 
+            formed.groups[g] = groupQueues[shape].front(); 
+            groupQueues[shape].pop_front(); 
+            if (groupQueues[shape].empty()) {
+                nonEmptyShapes[shape / 64] &= ~(uint64_t{1} << (shape % 64));
+            }
+            auto need = shapeOf(shape); 
+            groupsQueued--; 
+            groupPlayersQueued -= need[Tank] + need[Healer] + need[DPS]; 
+        }
+
+        // Would this party have formed with flex players locked to their primary role? 
+        bool rigidOk = true; 
+        for (int r = 0; r < RoleCount; ++r) {
+            rigidOk &= rigidQueued[r] >= plan.open[r];
+        }
+        if (!rigidOk) {
+            flexExtraParties++;
+        }
+
+        for (int r = 0; r < RoleCount; ++r) {
+            if (plan.solos[r] > 0) {
+                rigidQueued[r].fetch_sub(plan.solos[r], std::memory_order_relaxed);
+            }
+        }
+
+        int flexTaken = 0; 
+        for (int mask : FlexMasks) {
+            if (plan.flex[mask] > 0) {
+                rigidQueued[std::countr_zero(static_cast<unsigned>(mask))].fetch_sub(plan.flex[mask], std::memory_order_relaxed); 
+                flexTaken += plan.flex[mask];
+            }
+        }
+        if (flexTaken > 0) {
+            flexQueued -= flexTaken; 
+            flexPlayersPlaced += flexTaken;
+        }
+        return true;
+    }
+
+    // Write a claimed party's notice; every later consumer reads this one copy (mtx must be held) 
+    NoticeRef publishParty(int instanceID, const FormedParty& formed) {
+        MatchNotice* notice = notices.take(); 
+        notice->sequence = ++nextNoticeSequence; 
+        notice->instanceId = instanceID; 
+        notice->party = instances[instanceID].party; 
+        notice->wallTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(); 
+        notice->playerCount = formed.playerCount; 
+        notice->groupCount = formed.groupCount; 
+        for (int r = 0; r < RoleCount; ++r) {
+            notice->remaining[r] = liveQueued[roleBit(r)].load(std::memory_order_relaxed);
+        }
+        notice->formedAt = formed.formedAt; 
+        std::copy_n(formed.players.begin(), formed.playerCount, notice->ids.begin()); 
+        for (int i = 0; i < formed.playerCount; ++i) {
+            notice->enqueuedAt[i] = players.at(formed.players[i])->enqueuedAt;
+        }
+        for (int g = 0; g < formed.groupCount; ++g) {
+            notice->ids[formed.playerCount + g] = formed.groups[g].id; 
+            notice->enqueuedAt[formed.playerCount + g] = formed.groups[g].enqueuedAt;
+        }
+        return NoticeRef(notice);
+    }
+
+    // Fill a pooled notice for one player joining a running instance, so consumers of party 
+    // notices (the network front end's WireMatched) hear about backfills the same way (mtx must be held) 
+    NoticeRef publishBackfill(int instanceID, int playerId) {
+        MatchNotice* notice = notices.take(); 
+        notice->sequence = ++nextNoticeSequence; 
+        notice->instanceId = instanceID; 
+        notice->party = instances[instanceID].party; 
+        notice->wallTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(); 
+        notice->playerCount = 1; 
+        notice->groupCount = 0; 
+        for (int r = 0; r < RoleCount; ++r) {
+            notice->remaining[r] = liveQueued[roleBit(r)].load(std::memory_order_relaxed);
+        }
+        notice->formedAt = steady_now_ns(); 
+        notice->ids[0] = playerId; 
+        notice->enqueuedAt[0] = players.at(playerId)->enqueuedAt; 
+        return NoticeRef(notice);
+    }
+
+    // Log a party formation straight from its notice 
+    void logFormed(const MatchNotice& notice) {
+        if (!logging) {
+            return;
+        }
+        char line[192]; 
+        int length = std::snprintf(line, sizeof(line), "Instance %d formed a %s party", notice.instanceId + 1, notice.party->name); 
+        if (notice.groupCount > 0) {
+            length += std::snprintf(line + length, sizeof(line) - length, " with %d pre-made group(s)", notice.groupCount);
+        }
+        length += std::snprintf(line + length, sizeof(line) - length, ". Remaining - Tanks: %d, Healers: %d, DPS: %d\n", 
+                                notice.remaining[Tank], notice.remaining[Healer], notice.remaining[DPS]); 
+        synchronized_print(std::string_view(line, std::min<size_t>(length, sizeof(line) - 1)));
+    }
+
+    // Mark an instance as running its party and hand the notice to its consumers (mtx must be held) 
+    void startParty(int instanceID, const NoticeRef& notice) {
+        if (wal) {
+            instances[instanceID].walLsn = logPartyStarted(instanceID, *notice);
+        }
+        instances[instanceID].status = InstanceActive; 
+        instances[instanceID].active = true; 
+        instances[instanceID].notice = notice; 
+        activeInstances.fetch_add(1, std::memory_order_relaxed); 
+        instances[instanceID].partiesServed++; 
+        totalPartiesFormed++; 
+
+        MetricsRegistry::Shard& shard = metrics.local(); 
+        shard.add(MetricPlayersMatched, notice->playerCount); 
+        if (notice->groupCount > 0) {
+            shard.add(MetricGroupsMatched, notice->groupCount);
+        }
+        if (matchListener) {
+            matchListener(notice);
+        }
+    }
+
+    // Append a party assignment to the WAL; returns its LSN 
+    uint64_t logPartyStarted(int instanceID, const MatchNotice& notice) {
+        static_assert(sizeof(int) == sizeof(int32_t)); 
+        WalEntry entry{}; 
+        entry.length = static_cast<uint32_t>(sizeof(WalEntry) + (notice.playerCount + notice.groupCount) * sizeof(int32_t)); 
+        entry.wallTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(); 
+        entry.type = WalPartyStarted; 
+        entry.playerCount = static_cast<uint8_t>(notice.playerCount); 
+        entry.groupCount = static_cast<uint8_t>(notice.groupCount); 
+        entry.instance = instanceID + 1; 
+        return wal->append(entry, reinterpret_cast<const int32_t*>(notice.ids.data()));
+    }
+
+    // Append a backfill assignment (one player joining a running instance) to the WAL; returns its LSN 
+    uint64_t logPlayerBackfilled(int instanceID, int playerId) {
+        WalEntry entry{}; 
+        entry.length = static_cast<uint32_t>(sizeof(WalEntry) + sizeof(int32_t)); 
+        entry.wallTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(); 
+        entry.type = WalPlayerBackfilled; 
+        entry.playerCount = 1; 
+        entry.instance = instanceID + 1; 
+        int32_t id = playerId; 
+        return wal->append(entry, &id);
+    }
+
+    // Reserve the instance and ask the party's players to accept (mtx must be held). 
+    // Returns true if the check passed straight away. 
+    bool beginReadyCheck(int instanceID, const FormedParty& formed, const NoticeRef& notice) {
+        // Sequence numbers wrap long before an old deadline for the same instance could be left 
+        int id = ((nextReadyCheckId++ & 0xFFFFF) << ReadyCheckInstanceBits) | instanceID; 
+        ReadyCheck& check = instances[instanceID].readyCheck; 
+        openReadyChecks++; 
+        check.id = id; 
+        check.instanceId = instanceID; 
+        check.party = formed; 
+        check.notice = notice; 
+        check.pending = formed.playerCount; 
+        for (int i = 0; i < formed.playerCount; ++i) {
+            check.responses[i] = Pending; 
+            players.at(formed.players[i])->readyCheck = id;
+        }
+
+        instances[instanceID].reserved = true; 
+        instances[instanceID].status = InstanceReady; 
+        RuntimeConfig current = settings(); 
+        readyDeadlines.emplace(std::chrono::steady_clock::now() + std::chrono::milliseconds(current.readyCheck.timeoutMs), id); 
+        timerCv.notify_one(); 
+
+        // Simulated clients: accept now or stay silent until the timeout 
+        if (current.readyCheck.simulatedAcceptRate >= 0.0) {
+            std::bernoulli_distribution accepts(std::min(1.0, current.readyCheck.simulatedAcceptRate)); 
+            for (int i = 0; i < formed.playerCount; ++i) {
+                if (accepts(drawsFor(instanceID)) && !recordResponse(id, formed.players[i], true)) {
+                    break;
+                }
+            }
+        }
+
+        if (instances[instanceID].confirmed) {
+            instances[instanceID].confirmed = false; 
+            return true;
+        }
+        return false;
+    }
+
+    // The open ready check with this id, or nullptr once it has been resolved (mtx must be held) 
+    ReadyCheck* findReadyCheck(int checkId) {
+        int instanceId = checkId & ((1 << ReadyCheckInstanceBits) - 1); 
+        if (checkId < 0 || instanceId >= maxInstances || instances[instanceId].readyCheck.id != checkId) {
+            return nullptr;
+        }
+        return &instances[instanceId].readyCheck;
+    }
+
+    // Apply one player's answer; returns false if the check is gone or already answered (mtx must be held) 
+    bool recordResponse(int checkId, int playerId, bool accept) {
+        ReadyCheck* found = findReadyCheck(checkId); 
+        if (found == nullptr) {
+            return false;
+        }
+
+        ReadyCheck& check = *found; 
+        for (int i = 0; i < check.party.playerCount; ++i) {
+            if (check.party.players[i] != playerId) {
+                continue;
+            }
+            if (check.responses[i] != Pending) {
+                return false;
+            }
+            check.responses[i] = accept ? Accepted : Declined; 
+            if (!accept) {
+                resolveReadyCheck(checkId, false);
+            } else if (--check.pending == 0) {
+                resolveReadyCheck(checkId, true);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Finish a ready check: start the party, or release the instance and requeue its members (mtx must be held) 
+    void resolveReadyCheck(int checkId, bool passed) {
+        ReadyCheck* found = findReadyCheck(checkId); 
+        if (found == nullptr) {
+            return;
+        }
+        // Closed first; the party and notice stay in place until this returns 
+        ReadyCheck& check = *found; 
+        check.id = -1; 
+        openReadyChecks--; 
+        // Deadlines of closed checks at the top are spent; popping them keeps the heap at the number 
+        // of checks that can still expire instead of every check since the last timeout 
+        while (!readyDeadlines.empty() && findReadyCheck(readyDeadlines.top().second) == nullptr) {
+            readyDeadlines.pop();
+        }
+
+        Instance& instance = instances[check.instanceId]; 
+        instance.reserved = false; 
+        for (int i = 0; i < check.party.playerCount; ++i) {
+            players.at(check.party.players[i])->readyCheck = -1;
+        }
+
+        if (passed) {
+            readyChecksPassed++; 
+            startParty(check.instanceId, check.notice); 
+            check.notice.reset(); 
+            instance.confirmed = true; 
+            cv.notify_all(); 
+            return;
+        }
+
+        // Groups and players, including those who declined or didn't answer, go back to the front of 
+        // their queues in their original order 
+        readyChecksFailed++; 
+        instance.status = InstanceEmpty; 
+        check.notice.reset(); 
+        for (int g = check.party.groupCount - 1; g >= 0; --g) {
+            const Group& group = check.party.groups[g]; 
+            int shape = shapeIndex(group.shape[Tank], group.shape[Healer], group.shape[DPS]); 
+            groupQueues[shape].push_front(group); 
+            nonEmptyShapes[shape / 64] |= uint64_t{1} << (shape % 64); 
+            groupsQueued++; 
+            groupPlayersQueued += group.shape[Tank] + group.shape[Healer] + group.shape[DPS]; 
+            groupsPlaced--;
+        }
+
+        int unready = 0; 
+        for (int i = check.party.playerCount - 1; i >= 0; --i) {
+            int id = check.party.players[i]; 
+            PlayerTable::Record* record = players.at(id); 
+            if (check.responses[i] != Accepted) {
+                unready++;
+            }
+
+            int roleMask = record->roleMask; 
+            record->state.store(PlayerTable::Queued, std::memory_order_release); 
+            queueFor(roleMask).push_front(id, record->tier); 
+            liveQueued[roleMask].fetch_add(1, std::memory_order_relaxed); 
+            rigidQueued[std::countr_zero(static_cast<unsigned>(roleMask))].fetch_add(1, std::memory_order_relaxed); 
+            if (!std::has_single_bit(static_cast<unsigned>(roleMask))) {
+                flexQueued++; 
+                flexPlayersPlaced--;
+            }
+        }
+        readyCheckUnready += unready; 
+
+        logf("Instance %d ready check failed: %d player(s) declined or timed out, %d returned to queue", 
+             check.instanceId + 1, unready, check.party.playerCount); 
+        cv.notify_all();
+    }
+
+    // Fail every ready check still waiting for answers, so its players are queued again rather than 
+    // left matched to a party that will never start (on stop, once the timer thread has exited) 
+    void failPendingReadyChecks() {
+        std::lock_guard<std::mutex> lock(mtx); 
+        for (int i = 0; i < maxInstances && openReadyChecks > 0; ++i) {
+            resolveReadyCheck(instances[i].readyCheck.id, false);
+        }
+        readyDeadlines = {};
+    }
+
+    // Claim one queued player able to fill the role, single-role queue first (mtx must be held) 
+    bool claimOnePlayer(int role, int& playerId) {
+        int masks[1 + std::size(FlexMasks)]; 
+        int maskCount = 0; 
+        masks[maskCount++] = roleBit(role); 
+        for (int mask : FlexMasks) {
+            if (mask & roleBit(role)) {
+                masks[maskCount++] = mask;
+            }
+        }
+
+        for (int k = 0; k < maskCount; ++k) {
+            int roleMask = masks[k]; 
+            if (liveQueued[roleMask].load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            uint64_t popped = 0; 
+            int64_t now = steady_now_ns(); 
+            int got = claimFromQueue(roleMask, 1, &playerId, popped, now); 
+            advanceHead(roleMask, popped); 
+            if (got == 0) {
+                continue;
+            }
+
+            players.at(playerId)->state.store(PlayerTable::Matched, std::memory_order_release); 
+            recordWait(playerId, now, metrics.local()); 
+            liveQueued[roleMask].fetch_sub(1, std::memory_order_relaxed); 
+            rigidQueued[std::countr_zero(static_cast<unsigned>(roleMask))].fetch_sub(1, std::memory_order_relaxed); 
+            if (!std::has_single_bit(static_cast<unsigned>(roleMask))) {
+                flexQueued--; 
+                flexPlayersPlaced++;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Fill pending backfill requests, oldest first per role, from the queues (mtx must be held) 
+    void serveBackfills() {
+        auto now = std::chrono::steady_clock::now(); 
+        for (int r = 0; r < RoleCount; ++r) {
+            auto& requests = backfillQueues[r]; 
+            int playerId; 
+            while (!requests.empty() && claimOnePlayer(r, playerId)) {
+                BackfillRequest request = requests.front(); 
+                requests.pop_front(); 
+                pendingBackfills--; 
+
+                auto waited = now - request.requested; 
+                backfillLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count()); 
+                if (wal) {
+                    logPlayerBackfilled(request.instanceId, playerId);
+                }
+                if (matchListener) {
+                    matchListener(publishBackfill(request.instanceId, playerId));
+                }
+
+                logf("Instance %d backfilled %s slot with player %d (waited %lldms)", request.instanceId + 1, roleName[r], 
+                     playerId, static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(waited).count()));
+            }
+        }
+    }
+
+    // Drop backfill requests of an instance whose dungeon ended (mtx must be held). One pass 
+    // rotates each ring, putting back the requests it keeps in order, so nothing is allocated. 
+    void abandonBackfills(int instanceId) {
+        for (auto& requests : backfillQueues) {
+            int dropped = 0; 
+            for (size_t n = requests.size(); n > 0; --n) {
+                BackfillRequest request = requests.front(); 
+                requests.pop_front(); 
+                if (request.instanceId == instanceId) {
+                    dropped++;
+                } else {
+                    requests.push_back(request);
+                }
+            }
+            pendingBackfills -= dropped; 
+            backfillsAbandoned += dropped;
+        }
+    }
+
+    // Expire ready checks whose deadline passed; one thread serves every pending check 
+    void readyCheckTimer() {
+        std::unique_lock<std::mutex> lock(mtx); 
+        while (running.load()) {
+            if (readyDeadlines.empty()) {
+                timerCv.wait(lock, [this] { return !running.load() || !readyDeadlines.empty(); }); 
+                continue;
+            }
+
+            auto deadline = readyDeadlines.top().first; 
+            if (timerCv.wait_until(lock, deadline) == std::cv_status::no_timeout) {
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now(); 
+            while (!readyDeadlines.empty() && readyDeadlines.top().first <= now) {
+                int id = readyDeadlines.top().second; 
+                readyDeadlines.pop(); 
+                resolveReadyCheck(id, false);
+            }
+        }
+    }
+
+    // Improved party formation with better distribution 
+    bool tryFormParty(int instanceID) {
+        std::unique_lock<std::mutex> lock = lockTimed(); 
+
+        const PartyTemplate& party = *instances[instanceID].party; 
+
+        Instance& instance = instances[instanceID]; 
+
+        // Use timed wait to prevent instances from starving one another; each predicate check 
+        // after the first is a wakeup 
+        int64_t waitBegin = timeline ? timeline->now() : 0; 
+        int checks = 0; 
+        bool ready = cv.wait_for(lock, std::chrono::milliseconds(100), 
+                        [this, &party, &instance, &checks, instanceID] { 
+                            checks++; 
+                            return instance.confirmed || instance.retiring.load() || !running.load() || (!instance.reserved && !instance.draining.load() && 
+                                                          canFormParty(party) && instancesWaiting > 0 && 
+                                                          (!deterministic || turnOwner() == instanceID)); 
+                        }); 
+        if (timeline) {
+            timeline->span(TimelinePartyWait, waitBegin, timeline->now(), checks - 1, ready);
+        }
+        if (!ready || instance.retiring.load()) {
+            return false;
+        } 
+
+        // Replacements for running dungeons take priority over new parties 
+        if (pendingBackfills != 0) {
+            serveBackfills();
+        }
+
+        // A party held through its ready check is good to go 
+        if (instance.confirmed) {
+            instance.confirmed = false; 
+            return true;
+        }
+
+        // No new assignments once the WAL can't make them durable 
+        PartyPlan plan; 
+        if (!planParty(party, plan) || !running.load() || (wal && wal->error() != 0)) {
+            return false;
+        } 
+
+        // Remove players from queues to form party 
+        FormedParty formed; 
+        if (!claimParty(plan, formed)) {
+            return false;
+        }
+        if (deterministic) {
+            planDeterministic(instance); 
+            cv.notify_all();
+        }
+
+        NoticeRef notice = publishParty(instanceID, formed); 
+        logFormed(*notice); 
+        if (timeline) {
+            timeline->instant(TimelineFormed, notice->playerCount, notice->groupCount); 
+            timeline->instant(TimelineQueued, notice->remaining[Tank], notice->remaining[Healer], notice->remaining[DPS]);
+        }
+        if (trace) {
+            trace->record(TraceFormed, instanceID, -1, party.size(), 0, 0, plan.groupCount);
+        }
+
+        // Pre-made groups accepted as a unit when they queued and have no player ids to answer 
+        // with, so a party made only of groups starts without a check 
+        if (settings().readyCheck.enabled && formed.playerCount > 0) {
+            return beginReadyCheck(instanceID, formed, notice);
+        }
+        startParty(instanceID, notice); 
+        return true;
+    }
+
+    // Ask for a single-role replacement for a running instance; returns the request id or -1 
+    int requestBackfill(int instanceId, int role) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        if (instanceId < 0 || instanceId >= maxInstances || role < 0 || role >= RoleCount || !instances[instanceId].active) {
+            return -1;
+        }
+
+        int id = nextBackfillId++; 
+        backfillQueues[role].push_back(BackfillRequest{id, instanceId, std::chrono::steady_clock::now()}); 
+        pendingBackfills++; 
+
+        logf("Instance %d lost a member and requested a %s backfill", instanceId + 1, roleNames[role]); 
+        serveBackfills(); 
+        return id;
+    }
+
+    // Answer a ready check for a player; returns false if the player has no pending check 
+    bool respondReadyCheck(int playerId, bool accept) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        const PlayerTable::Record* record = players.find(playerId); 
+        if (record == nullptr || record->readyCheck < 0) {
+            return false;
+        }
+        return recordResponse(record->readyCheck, playerId, accept);
+    }
+
+    // Instance thread function with improved synchronzation 
+    void instanceWorker(int instanceId) {
+        metrics.local().instance.store(instanceId, std::memory_order_relaxed); 
+        if (timeline) {
+            timeline->nameThread(instanceId + 1, "Instance " + std::to_string(instanceId + 1));
+        }
+        Instance& self = instances[instanceId]; 
+        while (running.load() && !self.retiring.load()) {
+            refreshRates(); 
+
+            {
+                std::unique_lock<std::mutex> lock = lockTimed(); 
+                instancesWaiting++; 
+            } 
+
+            int backoffMs; 
+            if (tryFormParty(instanceId)) {
+                // Successfully formed a party, run dungeon once its assignment is durable. If the 
+                // log failed the assignment never took effect on disk, so the dungeon is abandoned. 
+                bool durable = true; 
+                if (wal) {
+                    int64_t walBegin = timeline ? timeline->now() : 0; 
+                    durable = wal->waitDurable(instances[instanceId].walLsn); 
+                    if (timeline) {
+                        timeline->span(TimelineWalWait, walBegin, timeline->now());
+                    }
+                }
+                runDungeon(instanceId, !durable); 
+
+                // Small delay to give other instances a chance 
+                backoffMs = 50;
+            } else {
+                // Couldn't form party, wait before trying 
+                backoffMs = 200;
+            } 
+            int64_t sleepBegin = timeline ? timeline->now() : 0; 
+            sleepUnless(std::chrono::milliseconds(backoffMs), [this]() { return !running.load(); }); 
+            if (timeline) {
+                timeline->span(TimelineBackoff, sleepBegin, timeline->now(), backoffMs);
+            }
+
+            {
+                std::unique_lock<std::mutex> lock = lockTimed(); 
+                instancesWaiting--;
+            }
+        }
+
+        if (self.retiring.load()) {
+            {
+                std::lock_guard<std::mutex> lock(mtx); 
+                self.status = InstanceRetired; 
+                for (int r = 0; r < RoleCount; ++r) {
+                    instanceSlots[r].fetch_sub(self.party->slots[r], std::memory_order_relaxed);
+                }
+            }
+            self.retired.store(true, std::memory_order_release);
+        }
+    }
+
+    // Sleep for up to duration unless wake() becomes true first (stop() notifies sleepCv). Returns 
+    // true if the whole duration passed. 
+    template <typename Duration, typename Predicate>
+    bool sleepUnless(Duration duration, Predicate wake) {
+        std::unique_lock<std::mutex> lock(sleepMtx); 
+        return !sleepCv.wait_for(lock, duration, wake);
+    }
+
+    // Fold a finished party's timestamps into the per-stage histograms (mtx must be held) 
+    void recordStages(const MatchNotice& notice, int64_t startedAt, int64_t completedAt) {
+        for (int i = 0; i < notice.playerCount + notice.groupCount; ++i) {
+            stageLatency[StageQueued].record(notice.formedAt - notice.enqueuedAt[i]); 
+            stageLatency[StageEndToEnd].record(startedAt - notice.enqueuedAt[i]);
+        }
+        stageLatency[StageStarting].record(startedAt - notice.formedAt); 
+        stageLatency[StageRunning].record(completedAt - startedAt);
+    }
+
+    // Simulate dungeon run with random time; with abandon, end it at once without running it 
+    void runDungeon(int instanceId, bool abandon = false) {
+        std::mt19937& draws = drawsFor(instanceId); 
+        RuntimeConfig current = settings(); 
+        int dungeonTime; 
+        if (deterministic && instances[instanceId].notice) {
+            dungeonTime = instances[instanceId].plannedTime;
+        } else {
+            dungeonTime = std::uniform_int_distribution<>(current.minTime, current.maxTime)(draws);
+        }
+
+        if (abandon) {
+            logf("Instance %d abandoned its party: WAL failed (%s)", instanceId + 1, std::strerror(wal ? wal->error() : EIO));
+        } else {
+            logf("Instance %d starting dungeon (estimated time: %ds)", instanceId + 1, dungeonTime); 
+            if (trace) {
+                trace->record(TraceDungeonStart, instanceId, -1, dungeonTime);
+            }
+        }
+
+        // Simulate dungeon run time, possibly losing a member part way through 
+        int64_t startedAt = steady_now_ns(); 
+        int64_t timelineBegin = timeline ? timeline->now() : 0; 
+        auto busySince = std::chrono::steady_clock::now(); 
+        std::chrono::milliseconds remaining = std::chrono::seconds(dungeonTime); 
+        if (!abandon && current.backfill.leaveRate > 0.0 && dungeonTime > 0) {
+            std::bernoulli_distribution leaves(std::min(1.0, current.backfill.leaveRate)); 
+            if (leaves(draws)) {
+                const PartyTemplate& party = *instances[instanceId].party; 
+                std::uniform_int_distribution<> seat(0, party.size() - 1), at(0, static_cast<int>(remaining.count())); 
+                int slot = seat(draws), role = 0; 
+                while (slot >= party.slots[role]) {
+                    slot -= party.slots[role++];
+                }
+                std::chrono::milliseconds leaveAt(at(draws)); 
+                if (sleepUnless(leaveAt, [this]() { return aborting.load(); })) {
+                    remaining -= leaveAt; 
+                    requestBackfill(instanceId, role);
+                }
+            }
+        }
+        bool aborted = abandon || aborting.load() || (remaining.count() > 0 && !sleepUnless(remaining, [this]() { return aborting.load(); })); 
+        auto busy = std::chrono::steady_clock::now() - busySince; 
+        metrics.local().add(MetricBusyNs, std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count()); 
+        int secondsRun = aborted ? static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(busy).count()) : dungeonTime; 
+
+        // Update instance status 
+        std::unique_lock<std::mutex> lock = lockTimed(); 
+        if (timeline && instances[instanceId].notice) {
+            const MatchNotice& notice = *instances[instanceId].notice; 
+            timeline->span(TimelineDungeon, timelineBegin, timeline->now(), notice.playerCount, notice.groupCount, dungeonTime);
+        }
+        if (pendingBackfills != 0) {
+            abandonBackfills(instanceId);
+        }
+        if (instances[instanceId].notice) {
+            if (!aborted) {
+                recordStages(*instances[instanceId].notice, startedAt, steady_now_ns());
+            }
+            instances[instanceId].notice.reset();
+        }
+        instances[instanceId].status = InstanceEmpty; 
+        instances[instanceId].active = false; 
+        activeInstances.fetch_sub(1, std::memory_order_relaxed); 
+        if (aborted) {
+            dungeonsAborted.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            dungeonsCompleted.fetch_add(1, std::memory_order_relaxed); 
+            dungeonSecondsCompleted.fetch_add(dungeonTime, std::memory_order_relaxed);
+        }
+        instances[instanceId].totalTimeServed += secondsRun; 
+        if (stateAttached && instanceId < StateHeader::MaxInstances) {
+            stateFile.header()->instanceStats[instanceId].partiesServed = instances[instanceId].partiesServed; 
+            stateFile.header()->instanceStats[instanceId].totalTimeServed = instances[instanceId].totalTimeServed;
+        }
+
+        if (aborted && !abandon) {
+            logf("Instance %d aborted dungeon after %ds of %ds", instanceId + 1, secondsRun, dungeonTime);
+        } else if (!aborted) {
+            logf("Instance %d completed dungeon in %ds", instanceId + 1, dungeonTime);
+        }
+        if (trace) {
+            trace->record(TraceDungeonEnd, instanceId, -1, secondsRun);
+        }
+        if (wal) {
+            WalEntry entry{}; 
+            entry.length = sizeof(WalEntry); 
+            entry.wallTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count(); 
+            entry.type = aborted ? WalDungeonAborted : WalDungeonCompleted; 
+            entry.instance = instanceId + 1; 
+            entry.value = secondsRun; 
+            wal->append(entry, nullptr);
+        }
+        cv.notify_all(); 
+    }
+
+    // Parties the single-role queues could fill right now for a template (mtx must be held) 
+    int formableParties(const PartyTemplate& party) {
+        int parties = std::numeric_limits<int>::max(); 
+        for (int r = 0; r < RoleCount; ++r) {
+            if (party.slots[r] > 0) {
+                parties = std::min(parties, liveQueued[roleBit(r)].load(std::memory_order_relaxed) / party.slots[r]);
+            }
+        }
+        return parties == std::numeric_limits<int>::max() ? 0 : parties;
+    }
+
+    // Longest time any player at the front of a single-role queue has waited (mtx must be held) 
+    int64_t oldestQueuedNs(int64_t now) {
+        int64_t oldest = 0; 
+        for (int r = 0; r < RoleCount; ++r) {
+            auto& queue = queueFor(roleBit(r)); 
+            for (int t = 0; t < TierCount; ++t) {
+                if (!queue.empty(t)) {
+                    oldest = std::max(oldest, now - players.at(queue.front(t))->enqueuedAt);
+                }
+            }
+        }
+        return oldest;
+    }
+
+    // Start one more instance of a template, reusing a retired slot of it if there is one (mtx must be held) 
+    bool scaleUp(const PartyTemplate& party) {
+        int slot = -1; 
+        for (int i = 0; i < maxInstances && slot < 0; ++i) {
+            if (instances[i].party == &party && instances[i].retired.load(std::memory_order_acquire)) {
+                slot = i;
+            }
+        }
+        if (slot >= 0) {
+            // The old thread has released mtx for good, so joining here can't block on us 
+            Instance& instance = instances[slot]; 
+            instance.thread.join(); 
+            instance.retired.store(false); 
+            instance.retiring.store(false); 
+            instance.status = InstanceEmpty; 
+            for (int r = 0; r < RoleCount; ++r) {
+                instanceSlots[r].fetch_add(instance.party->slots[r], std::memory_order_relaxed);
+            }
+        } else {
+            if (instances.emplace_back(maxInstances + 1, &party) == nullptr) {
+                return false;
+            }
+            slot = maxInstances++; 
+            instances[slot].partyGen.seed(gen()); 
+            if (stateAttached) {
+                stateFile.header()->instances = maxInstances;
+            }
+            for (int r = 0; r < RoleCount; ++r) {
+                instanceSlots[r].fetch_add(instances[slot].party->slots[r], std::memory_order_relaxed);
+            }
+        }
+        instances[slot].thread = std::thread([this, slot]() {
+            instanceWorker(slot);
+        }); 
+        liveInstances.fetch_add(1); 
+        return true;
+    }
+
+    // Demand entry for a template, added on first use (mtx must be held) 
+    TemplateDemand& demandFor(const PartyTemplate* party) {
+        for (auto& demand : templateDemand) {
+            if (demand.party == party) {
+                return demand;
+            }
+        }
+        return templateDemand.emplace_back(TemplateDemand{party, 0, formableParties(*party)});
+    }
+
+    // One autoscaler sample: count live instances, find the template whose formable parties most 
+    // outnumber its idle instances (nullptr if none), and the highest-numbered idle instance whose 
+    // template has nothing to form (retire, or -1). A drained instance still costs instance-seconds 
+    // but is not capacity. (mtx must be held) 
+    const TemplateDemand* sampleDemand(int& live, int& retire) {
+        live = 0; 
+        retire = -1; 
+        templateDemand.clear(); 
+        for (int i = 0; i < maxInstances; ++i) {
+            const Instance& instance = instances[i]; 
+            if (instance.thread.joinable() && !instance.retiring.load()) {
+                live++; 
+                TemplateDemand& demand = demandFor(instance.party); 
+                if (!instance.active && !instance.reserved && !instance.draining.load()) {
+                    demand.idle++; 
+                    retire = demand.backlog == 0 ? i : retire;
+                }
+            }
+        }
+        const TemplateDemand* needed = nullptr; 
+        for (const auto& demand : templateDemand) {
+            if (demand.backlog > demand.idle && (needed == nullptr || demand.backlog - demand.idle > needed->backlog - needed->idle)) {
+                needed = &demand;
+            }
+        }
+        return needed;
+    }
+
+    // Sample demand every interval and resize the pool within the policy's bounds 
+    void autoscaler() {
+        const AutoscalePolicy& policy = autoscalePolicy; 
+        const auto cooldown = std::chrono::milliseconds(policy.cooldownMs); 
+        auto lastSample = std::chrono::steady_clock::now(), lastChange = lastSample - cooldown; 
+        int upStreak = 0, downStreak = 0; 
+
+        std::unique_lock<std::mutex> lock(mtx); 
+        while (!autoscaleCv.wait_for(lock, std::chrono::milliseconds(policy.intervalMs), [this] { return !running.load(); })) {
+            auto now = std::chrono::steady_clock::now(); 
+            double elapsed = std::chrono::duration<double>(now - lastSample).count(); 
+            lastSample = now; 
+
+            int live, idle; 
+            const TemplateDemand* needed = sampleDemand(live, idle); 
+            instanceSeconds += live * elapsed; 
+            autoscaledSeconds += elapsed; 
+            peakInstances = std::max(peakInstances, live); 
+
+            bool pressure = needed != nullptr && oldestQueuedNs(steady_now_ns()) >= policy.scaleUpWaitMs * 1000000LL; 
+            bool slack = idle >= 0; 
+            upStreak = pressure ? upStreak + 1 : 0; 
+            downStreak = slack ? downStreak + 1 : 0; 
+            if (now - lastChange < cooldown) {
+                continue;
+            }
+
+            if (upStreak >= policy.scaleUpSamples && live < policy.maxInstances && needed != nullptr) {
+                const PartyTemplate& party = *needed->party; 
+                int added = 0, backlog = needed->backlog; 
+                for (int want = std::min(backlog - needed->idle, policy.maxInstances - live); added < want && scaleUp(party); ++added) {}
+                if (added > 0) {
+                    scaleUps += added; 
+                    logf("Autoscaler added %d %s instance(s): %d live, %d parties waiting", added, party.name, live + added, backlog);
+                }
+                upStreak = 0; 
+                lastChange = now;
+            } else if (downStreak >= policy.scaleDownSamples && live > policy.minInstances && slack) {
+                instances[idle].retiring.store(true); 
+                liveInstances.fetch_sub(1); 
+                scaleDowns++; 
+                logf("Autoscaler retired instance %d: %d live", idle + 1, live - 1); 
+                cv.notify_all(); 
+                downStreak = 0; 
+                lastChange = now;
+            }
+        }
+    }
+
+    // Start LFG system 
+    void start() {
+        for (int i = 0; i < maxInstances; ++i) {
+            instances[i].thread = std::thread([this, i]() {
+                instanceWorker(i);
+            });
+        }
+        liveInstances.store(maxInstances); 
+        peakInstances = maxInstances; 
+        if (autoscalePolicy.enabled) {
+            autoscaleThread = std::thread([this]() {
+                autoscaler();
+            });
+        }
+        if (settings().readyCheck.enabled) {
+            std::lock_guard<std::mutex> lock(mtx); 
+            startReadyCheckTimer();
+        }
+    } 
+
+    // Start the ready-check timer thread if it isn't running (mtx must be held) 
+    void startReadyCheckTimer() {
+        if (!timerThread.joinable() && running.load()) {
+            timerThread = std::thread([this]() {
+                readyCheckTimer();
+            });
+        }
+    }
+
+    // Copy of the current runtime settings. If a writer republished the slot between loading it 
+    // and pinning it, the pin is dropped and the load retried. 
+    RuntimeConfig settings() const {
+        for (;;) {
+            ConfigSlot* slot = config.load(); 
+            slot->readers.fetch_add(1); 
+            if (config.load() == slot) {
+                RuntimeConfig current = slot->config; 
+                slot->readers.fetch_sub(1); 
+                return current;
+            }
+            slot->readers.fetch_sub(1);
+        }
+    }
+
+    // Fill a slot that is neither current nor being read, then make it current. Readers pin a 
+    // slot only while copying it, so a free one turns up almost at once. 
+    void publishConfig(const RuntimeConfig& next) {
+        std::lock_guard<std::mutex> lock(configMtx); 
+        ConfigSlot* current = config.load(); 
+        for (;;) {
+            for (ConfigSlot& slot : configSlots) {
+                if (&slot != current && slot.readers.load() == 0) {
+                    slot.config = next; 
+                    config.store(&slot); 
+                    return;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Publish new clear times and policies while running. Dungeons and ready checks already 
+    // under way finish with the version they started with; everything after uses the new one. 
+    // Returns false, changing nothing, if any value is out of range (see RuntimeConfig::valid). 
+    bool reconfigure(const RuntimeConfig& next) {
+        if (!next.valid()) {
+            return false;
+        }
+        publishConfig(next); 
+        if (next.readyCheck.enabled) {
+            std::lock_guard<std::mutex> lock(mtx); 
+            startReadyCheckTimer();
+        }
+        logf("Reconfigured: clear time %d-%ds, ready checks %s, leave rate %.2f", next.minTime, next.maxTime, 
+             next.readyCheck.enabled ? "on" : "off", next.backfill.leaveRate); 
+        return true;
+    }
+
+    // Stop forming new parties on an instance; a dungeon or ready check in flight finishes first. 
+    // Returns false for an unknown instance. 
+    bool drainInstance(int instanceId) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        if (instanceId < 0 || instanceId >= maxInstances) {
+            return false;
+        }
+        instances[instanceId].draining.store(true); 
+        logf("Instance %d draining%s", instanceId + 1, instances[instanceId].active ? " after its current dungeon" : ""); 
+        cv.notify_all(); 
+        return true;
+    }
+
+    // Let a drained instance form parties again 
+    bool resumeInstance(int instanceId) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        if (instanceId < 0 || instanceId >= maxInstances) {
+            return false;
+        }
+        instances[instanceId].draining.store(false); 
+        cv.notify_all(); 
+        return true;
+    }
+
+    // True once a draining instance has no dungeon or ready check left 
+    bool isDrained(int instanceId) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        if (instanceId < 0 || instanceId >= maxInstances) {
+            return false;
+        }
+        const Instance& instance = instances[instanceId]; 
+        return instance.draining.load() && !instance.active && !instance.reserved;
+    } 
+
+    // Stop LFG system. Idle workers wake at once; with StopMode::Abort running dungeons end 
+    // early too, so this returns within milliseconds instead of after the longest dungeon. 
+    // Only the first call does anything (the destructor calls it again); a concurrent second 
+    // call waits for the first to finish. 
+    void stop(StopMode mode = StopMode::FinishInFlight) {
+        std::lock_guard<std::mutex> once(stopMtx); 
+        if (stopped) {
+            return;
+        }
+        stopped = true; 
+        {
+            std::lock_guard<std::mutex> lock(mtx); 
+            running.store(false); 
+        }
+        {
+            // Under sleepMtx so a sleeper can't check its condition and then miss the notify 
+            std::lock_guard<std::mutex> lock(sleepMtx); 
+            if (mode == StopMode::Abort) {
+                aborting.store(true);
+            }
+        }
+        sleepCv.notify_all(); 
+        cv.notify_all(); 
+        timerCv.notify_all(); 
+        metricsCv.notify_all(); 
+        autoscaleCv.notify_all(); 
+        if (autoscaleThread.joinable()) {
+            autoscaleThread.join();
+        }
+        if (timerThread.joinable()) {
+            timerThread.join();
+        }
+
+        for (auto& instance : instances) {
+            if (instance.thread.joinable()) {
+                instance.thread.join();
+            }
+        }
+        failPendingReadyChecks(); 
+        if (trace) {
+            if (int error = trace->close()) {
+                synchronized_print(std::string("Trace write failed: ") + std::strerror(error));
+            }
+        }
+        if (timeline && !timeline->write()) {
+            synchronized_print("Cannot write timeline trace");
+        }
+        if (timeline && timeline->droppedCount() > 0) {
+            logf("Timeline full: %zu later events dropped (%zu kept per thread)", timeline->droppedCount(), TimelineTracer::BufferEvents);
+        }
+        if (stateAttached) {
+            stateFile.sync();
+        }
+        if (wal) {
+            wal->close();
+        }
+        if (metricsThread.joinable()) {
+            metricsThread.join(); 
+            dumpMetrics();
+        }
+    }
+
+    // Display current status 
+    void displayStatus() {
+        std::lock_guard<std::mutex> lock(mtx); 
+        
+        synchronized_print("\n=== Current Instance Status ==="); 
+        for (const auto& instance : instances) {
+            std::ostringstream oss; 
+            oss << "Instance " << std::setw(2) << instance.id 
+                << " [" << instance.party->name << "]"
+                << ": " << std::setw(6) << instanceStatusNames[instance.status] 
+                << " | Parties served: " << std::setw(3) << instance.partiesServed 
+                << " | Total time: " << std::setw(4) << instance.totalTimeServed 
+                << "s"; 
+            if (instance.draining.load()) {
+                oss << " (draining)";
+            }
+            synchronized_print(oss.str());
+        }
+
+        synchronized_print("\n=== Queue Status ==="); 
+        for (int r = 0; r < RoleCount; ++r) {
+            std::ostringstream oss_role; 
+            oss_role << roleNames[r] << " in queue: " << liveQueued[roleBit(r)].load(); 
+            synchronized_print(oss_role.str()); 
+        }
+
+        std::ostringstream oss_flex; 
+        oss_flex << "Flex players in queue: " << flexQueued.load(); 
+        synchronized_print(oss_flex.str()); 
+
+        std::ostringstream oss_groups; 
+        oss_groups << "Groups in queue: " << groupsQueued << " (" << groupPlayersQueued << " players)"; 
+        synchronized_print(oss_groups.str()); 
+
+        std::ostringstream oss4; 
+        oss4 << "Total parties formed: " << totalPartiesFormed.load(); 
+        synchronized_print(oss4.str()); 
+
+        std::ostringstream oss5; 
+        oss5 << "Instances waiting for parties: " << instancesWaiting.load(); 
+        synchronized_print(oss5.str());
+    }
+
+    // Wait for all current parties to complete 
+    void waitForCompletion() {
+        bool shouldWait; 
+        do {
+            std::this_thread::sleep_for(std::chrono::seconds(1)); 
+
+            std::lock_guard<std::mutex> lock(mtx); 
+            shouldWait = false; 
+
+            // Check if any isntance is active 
+            for (const auto& instance : instances) {
+                if (instance.active || instance.reserved) {
+                    shouldWait = true; 
+                    break;
+                }
+            } 
+
+            // Check if more parties can be formed 
+            if (!shouldWait && canFormAnyParty()) {
+                shouldWait = true;
+            }
+        } while(shouldWait);
+    }
+
+    // Get summary  statistics 
+    void displaySummary() {
+        std::lock_guard<std::mutex> lock(mtx); 
+        synchronized_print("\n=== Final Summary ==="); 
+
+        int totalParties = 0; 
+        int totalTime = 0; 
+        for (const auto& instance : instances) {
+            std::ostringstream oss; 
+            oss <<  "Instance " << std::setw(2) << instance.id 
+                << ": " << std::setw(3) << instance.partiesServed << " parties, "
+                << std::setw(4) << instance.totalTimeServed << " seconds total"; 
+            synchronized_print(oss.str());
+
+            totalParties += instance.partiesServed; 
+            totalTime += instance.totalTimeServed;
+        } 
+
+        std::ostringstream oss_total; 
+        oss_total << "System Total: " << totalParties << " parties, " << totalTime << " seconds"; 
+        synchronized_print(oss_total.str());
+
+        if (groupsPlaced.load() > 0) {
+            std::ostringstream oss_groups; 
+            oss_groups << "Pre-made groups placed: " << groupsPlaced.load(); 
+            synchronized_print(oss_groups.str());
+        }
+
+        if (uint64_t cancelled = metrics.total(MetricCancellations); cancelled > 0) {
+            std::ostringstream oss_cancel; 
+            oss_cancel << "Players cancelled: " << cancelled; 
+            synchronized_print(oss_cancel.str());
+        }
+
+        // Queue wait percentiles per priority tier 
+        for (int t = 0; t < TierCount; ++t) {
+            const LatencyHistogram& wait = tierWait[t]; 
+            if (wait.count() == 0) {
+                continue;
+            }
+            std::ostringstream oss_tier; 
+            oss_tier << tierNames[t] << " tier wait (" << wait.count() << " players): " << std::fixed << std::setprecision(1) 
+                     << "p50 " << wait.percentileMs(50) << "ms, p90 " << wait.percentileMs(90) << "ms, p99 " 
+                     << wait.percentileMs(99) << "ms, max " << wait.maxMs() << "ms"; 
+            synchronized_print(oss_tier.str());
+        }
+
+        // Where party latency goes, stage by stage 
+        for (int stage = 0; stage < StageCount; ++stage) {
+            const LatencyHistogram& latency = stageLatency[stage]; 
+            if (latency.count() == 0) {
+                continue;
+            }
+            std::ostringstream oss_stage; 
+            oss_stage << stageNames[stage] << " (" << latency.count() << "): " << std::fixed << std::setprecision(3) 
+                      << "p50 " << latency.percentileMs(50) << "ms, p99 " << latency.percentileMs(99) << "ms, p99.9 " 
+                      << latency.percentileMs(99.9) << "ms, max " << latency.maxMs() << "ms"; 
+            synchronized_print(oss_stage.str());
+        }
+
+        if (backfillLatency.count() > 0 || backfillsAbandoned > 0) {
+            std::ostringstream oss_backfill; 
+            oss_backfill << "Backfills: " << backfillLatency.count() << " filled, " << backfillsAbandoned 
+                         << " abandoned | latency avg " << std::fixed << std::setprecision(1) << backfillLatency.meanMs() 
+                         << "ms, p99 " << backfillLatency.percentileMs(99) << "ms, max " << backfillLatency.maxMs() << "ms"; 
+            synchronized_print(oss_backfill.str());
+        }
+
+        if (wal) {
+            std::ostringstream oss_wal; 
+            uint64_t entries = wal->entries(), syncs = wal->syncs(); 
+            oss_wal << "WAL: " << entries << " entries in " << syncs << " group commits (" << std::fixed 
+                    << std::setprecision(1) << (syncs > 0 ? static_cast<double>(entries) / syncs : 0.0) << " per fsync)"; 
+            if (wal->error() != 0) {
+                oss_wal << " | FAILED: " << std::strerror(wal->error());
+            }
+            synchronized_print(oss_wal.str());
+        }
+
+        if (readyChecksPassed.load() + readyChecksFailed.load() > 0) {
+            std::ostringstream oss_ready; 
+            oss_ready << "Ready checks: " << readyChecksPassed.load() << " passed, " << readyChecksFailed.load() 
+                      << " failed, " << readyCheckUnready.load() << " players declined or timed out"; 
+            synchronized_print(oss_ready.str());
+        }
+
+        if (dungeonsAborted.load() > 0) {
+            std::ostringstream oss_abort; 
+            oss_abort << "Dungeons aborted (shutdown or WAL failure): " << dungeonsAborted.load(); 
+            synchronized_print(oss_abort.str());
+        }
+
+        if (flexPlayersPlaced.load() > 0) {
+            std::ostringstream oss_flex; 
+            oss_flex << "Flex players placed: " << flexPlayersPlaced.load() 
+                     << " | Additional parties from flex roles: " << flexExtraParties.load(); 
+            synchronized_print(oss_flex.str());
+        }
+
+        // Pool size over time against a fixed pool as large as the peak 
+        if (autoscalePolicy.enabled && autoscaledSeconds > 0.0) {
+            double fixedSeconds = peakInstances * autoscaledSeconds; 
+            std::ostringstream oss_scale; 
+            oss_scale << "Autoscaling: " << scaleUps << " added, " << scaleDowns << " retired, peak " << peakInstances 
+                      << " | " << std::fixed << std::setprecision(1) << instanceSeconds << " instance-seconds vs " << fixedSeconds 
+                      << " for a fixed pool of " << peakInstances << " (" << (1.0 - instanceSeconds / fixedSeconds) * 100.0 << "% saved)"; 
+            synchronized_print(oss_scale.str());
+        }
+
+        // Calculate distribution fairness
+        if (totalParties > 0) {
+            double fairness = distributionFairness(); 
+            std::ostringstream oss_fair;
+            oss_fair << "Distribution fairness: " << std::fixed << std::setprecision(2) << (fairness * 100) << "%"; 
+            synchronized_print(oss_fair.str());
+        }
+    }
+
+    // See fairnessOf 
+    double distributionFairness() const {
+        std::vector<int> served; 
+        for (const auto& instance : instances) {
+            served.push_back(instance.partiesServed);
+        }
+        return fairnessOf(served);
+    }
+
+    // Render metrics as Prometheus text exposition format, or JSON 
+    std::string exportMetrics(bool json) {
+        std::array<int, RoleMaskCount> depth; 
+        for (int mask = 1; mask < RoleMaskCount; ++mask) {
+            depth[mask] = liveQueued[mask].load(std::memory_order_relaxed);
+        }
+        // The autoscaler may add instances, so take the count with the lock 
+        int instanceCount; 
+        std::vector<int> served; 
+        double fairness; 
+        {
+            std::lock_guard<std::mutex> lock(mtx); 
+            instanceCount = maxInstances; 
+            for (int i = 0; i < instanceCount; ++i) {
+                served.push_back(instances[i].partiesServed);
+            }
+            fairness = distributionFairness();
+        }
+        MetricsRegistry::Snapshot snap = metrics.snapshot(instanceCount); 
+
+        // Queue label for a role mask, e.g. "tank+healer" 
+        auto queueName = [](int mask) {
+            static constexpr const char* lower[RoleCount] = {"tank", "healer", "dps"}; 
+            std::string name; 
+            for (int r = 0; r < RoleCount; ++r) {
+                if (mask & roleBit(r)) {
+                    name += (name.empty() ? "" : "+"); 
+                    name += lower[r];
+                }
+            }
+            return name;
+        };
+
+        std::ostringstream out; 
+        out << std::setprecision(6); 
+        if (json) {
+            out << "{\"queue_depth\":{"; 
+            for (int mask = 1; mask < RoleMaskCount; ++mask) {
+                out << (mask > 1 ? "," : "") << '"' << queueName(mask) << "\":" << depth[mask];
+            }
+            out << "},\"parties_formed\":" << totalPartiesFormed.load() 
+                << ",\"players_matched\":" << snap.counters[MetricPlayersMatched] 
+                << ",\"groups_matched\":" << snap.counters[MetricGroupsMatched] 
+                << ",\"players_cancelled\":" << snap.counters[MetricCancellations] 
+                << ",\"dungeons_completed\":" << dungeonsCompleted.load() 
+                << ",\"active_instances\":" << activeInstances.load() 
+                << ",\"live_instances\":" << liveInstances.load() 
+                << ",\"fairness\":" << fairness << ",\"instances\":["; 
+            for (int i = 0; i < instanceCount; ++i) {
+                out << (i > 0 ? "," : "") << "{\"id\":" << (i + 1) << ",\"parties\":" << served[i] 
+                    << ",\"busy_seconds\":" << snap.instanceBusyNs[i] / 1e9 << "}";
+            }
+            out << "],\"match_wait_seconds\":{\"count\":" << snap.waitCount << ",\"sum\":" << snap.waitSum / 1e9 
+                << ",\"p50\":" << snap.waitPercentile(50) << ",\"p90\":" << snap.waitPercentile(90) 
+                << ",\"p99\":" << snap.waitPercentile(99) << "}}\n"; 
+            return out.str();
+        }
+
+        out << "# TYPE lfg_queue_depth gauge\n"; 
+        for (int mask = 1; mask < RoleMaskCount; ++mask) {
+            out << "lfg_queue_depth{roles=\"" << queueName(mask) << "\"} " << depth[mask] << "\n";
+        }
+        out << "# TYPE lfg_parties_formed_total counter\nlfg_parties_formed_total " << totalPartiesFormed.load() << "\n" 
+            << "# TYPE lfg_players_matched_total counter\nlfg_players_matched_total " << snap.counters[MetricPlayersMatched] << "\n" 
+            << "# TYPE lfg_groups_matched_total counter\nlfg_groups_matched_total " << snap.counters[MetricGroupsMatched] << "\n" 
+            << "# TYPE lfg_players_cancelled_total counter\nlfg_players_cancelled_total " << snap.counters[MetricCancellations] << "\n" 
+            << "# TYPE lfg_dungeons_completed_total counter\nlfg_dungeons_completed_total " << dungeonsCompleted.load() << "\n" 
+            << "# TYPE lfg_active_instances gauge\nlfg_active_instances " << activeInstances.load() << "\n" 
+            << "# TYPE lfg_live_instances gauge\nlfg_live_instances " << liveInstances.load() << "\n" 
+            << "# TYPE lfg_distribution_fairness gauge\nlfg_distribution_fairness " << fairness << "\n" 
+            << "# TYPE lfg_instance_parties_total counter\n"; 
+        for (int i = 0; i < instanceCount; ++i) {
+            out << "lfg_instance_parties_total{instance=\"" << (i + 1) << "\"} " << served[i] << "\n";
+        }
+        out << "# TYPE lfg_instance_busy_seconds_total counter\n"; 
+        for (int i = 0; i < instanceCount; ++i) {
+            out << "lfg_instance_busy_seconds_total{instance=\"" << (i + 1) << "\"} " << snap.instanceBusyNs[i] / 1e9 << "\n";
+        }
+
+        // Cumulative buckets from ~1ms to ~69s, every second power of two 
+        out << "# TYPE lfg_match_wait_seconds histogram\n"; 
+        uint64_t cumulative = 0; 
+        for (int b = 0; b <= MetricsRegistry::Buckets; ++b) {
+            cumulative += snap.waitBuckets[b]; 
+            if (b >= 20 && b <= 36 && b % 2 == 0) {
+                out << "lfg_match_wait_seconds_bucket{le=\"" << std::ldexp(1.0, b) / 1e9 << "\"} " << cumulative << "\n";
+            }
+        }
+        out << "lfg_match_wait_seconds_bucket{le=\"+Inf\"} " << snap.waitCount << "\n" 
+            << "lfg_match_wait_seconds_sum " << snap.waitSum / 1e9 << "\n" 
+            << "lfg_match_wait_seconds_count " << snap.waitCount << "\n"; 
+        return out.str();
+    }
+
+    // Get remaining players in queue 
+    void getRemainingPlayers(int& tanks, int& healers, int& dps) {
+        std::lock_guard<std::mutex> lock(mtx); 
+        tanks = liveQueued[roleBit(Tank)].load(); 
+        healers = liveQueued[roleBit(Healer)].load(); 
+        dps = liveQueued[roleBit(DPS)].load();
+    }
+};
+
+#ifdef LFG_HAVE_EPOLL
+// Wire protocol of the socket front end: fixed 20-byte frames in host byte order (the front end 
+// only listens locally). Every request gets one reply carrying its requestId; WireMatched is 
+// pushed unprompted when a player enqueued on the connection starts a dungeon. 
+enum WireType : uint8_t {
+    WireEnqueue = 1,        // roleMask, tier -> WireEnqueued 
+    WireCancel = 2,         // playerId -> WireCancelled 
+    WireStatus = 3,         // playerId -> WireStatusReply 
+    WireEnqueued = 4,       // playerId (-1 if rejected) 
+    WireCancelled = 5,      // flags = 1 if the player was removed 
+    WireStatusReply = 6,    // roleMask (0 if not queued), value = position, extra = estimated wait ms 
+    WireMatched = 7,        // playerId, value = instance (1-based) 
+    // Operator requests, accepted only by LFGAdmin 
+    WireReconfigure = 8,    // value = min, extra = max clear time (s) -> WireReconfigured 
+    WireReconfigured = 9,   // flags = 1 if applied 
+    WireDrain = 10,         // value = instance (1-based), flags = 1 to drain, 0 to resume -> WireDrained 
+    WireDrained = 11        // flags = 1 if accepted, extra = 1 once the instance is idle 
+};
+
+struct WireMessage {
+    uint8_t type; 
+    uint8_t roleMask; 
+    uint8_t tier; 
+    uint8_t flags; 
+    uint32_t requestId; 
+    int32_t playerId; 
+    int32_t value; 
+    int32_t extra;
+};
+
+static_assert(sizeof(WireMessage) == 20);
+
+// Raise the open-file soft limit to the hard limit so one process can hold many sockets 
+inline void raiseFileLimit() {
+    rlimit limit; 
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max; 
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Open a listening (server) or connected (client) stream socket. An address containing '/' is a 
+// Unix socket path, anything else a TCP port on 127.0.0.1. Returns -1 on failure. 
+inline int openStreamSocket(const std::string& address, bool server) {
+    bool local = address.find('/') != std::string::npos; 
+    int fd = ::socket(local ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0); 
+    if (fd < 0) {
+        return -1;
+    }
+
+    sockaddr_un unixAddress{}; 
+    sockaddr_in tcpAddress{}; 
+    sockaddr* target; 
+    socklen_t length; 
+    if (local) {
+        if (address.size() >= sizeof(unixAddress.sun_path)) {
+            ::close(fd); 
+            return -1;
+        }
+        unixAddress.sun_family = AF_UNIX; 
+        std::strncpy(unixAddress.sun_path, address.c_str(), sizeof(unixAddress.sun_path) - 1); 
+        target = reinterpret_cast<sockaddr*>(&unixAddress); 
+        length = sizeof(unixAddress); 
+        if (server) {
+            ::unlink(address.c_str());
+        }
+    } else {
+        tcpAddress.sin_family = AF_INET; 
+        tcpAddress.sin_port = htons(static_cast<uint16_t>(std::atoi(address.c_str()))); 
+        tcpAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK); 
+        target = reinterpret_cast<sockaddr*>(&tcpAddress); 
+        length = sizeof(tcpAddress); 
+        int on = 1; 
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+
+    bool ok = server ? ::bind(fd, target, length) == 0 && ::listen(fd, SOMAXCONN) == 0 
+                     : ::connect(fd, target, length) == 0; 
+    if (!ok) {
+        ::close(fd); 
+        return -1;
+    }
+    if (!local && !server) {
+        int on = 1; 
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK); 
+    return fd;
+}
+
+// I/O backends for the socket front end 
+enum class IoBackend { Epoll, Uring };
+
+// Single-threaded front end for an LFGSystem. With the epoll backend, sockets are non-blocking 
+// and level-triggered; with the io_uring backend every connection keeps one receive in flight and 
+// all receives, sends and accepts queued during a wakeup go to the kernel in one submission. 
+// Either way each wakeup handles every ready connection, submits all enqueues it read as one batch, 
+// then starts at most one write per connection. Replies to enqueues are sent after the batch is 
+// submitted, so they can follow replies to later requests on the same connection. Players stay 
+// queued if their connection closes. 
+class LFGServer {
+public: 
+    explicit LFGServer(LFGSystem& system) : system(system) {}
+
+    LFGServer(const LFGServer&) = delete; 
+    LFGServer& operator=(const LFGServer&) = delete; 
+
+    ~LFGServer() {
+        stop();
+    }
+
+    // Listen on address and start the event loop thread. Falls back to epoll if io_uring 
+    // is unavailable. 
+    bool start(const std::string& address, IoBackend requested = IoBackend::Epoll) {
+        raiseFileLimit(); 
+        listenFd = openStreamSocket(address, true); 
+        if (listenFd < 0) {
+            return false;
+        }
+        if (address.find('/') != std::string::npos) {
+            unixPath = address;
+        }
+        wakeFd = ::eventfd(0, EFD_CLOEXEC); 
+
+        backend = IoBackend::Epoll; 
+#ifdef LFG_HAVE_IO_URING
+        if (requested == IoBackend::Uring && ring.open(4096, 1 << 16)) {
+            backend = IoBackend::Uring; 
+            // The ring waits for readiness itself; blocking sockets avoid -EAGAIN completions 
+            ::fcntl(listenFd, F_SETFL, ::fcntl(listenFd, F_GETFL) & ~O_NONBLOCK);
+        }
+#endif
+        (void)requested; 
+        if (backend == IoBackend::Epoll) {
+            epollFd = ::epoll_create1(EPOLL_CLOEXEC); 
+            watch(listenFd, EPOLLIN, EPOLL_CTL_ADD); 
+            watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+
+        matches.reserve(1024); 
+        delivering.reserve(1024); 
+        system.setMatchListener([this](const NoticeRef& notice) {
+            std::lock_guard<std::mutex> lock(matchMtx); 
+            matches.push_back(notice); 
+            if (matches.size() == 1) {
+                wakeUp();
+            }
+        }); 
+        running = true; 
+        loop = std::thread([this]() {
+#ifdef LFG_HAVE_IO_URING
+            if (backend == IoBackend::Uring) {
+                runUring(); 
+                return;
+            }
+#endif
+            runEpoll();
+        }); 
+        return true;
+    }
+
+    void stop() {
+        if (!loop.joinable()) {
+            return;
+        }
+        running = false; 
+        wakeUp(); 
+        loop.join(); 
+        system.setMatchListener(nullptr); 
+#ifdef LFG_HAVE_IO_URING
+        ring.close(); 
+#endif
+
+        for (size_t fd = 0; fd < connections.size(); ++fd) {
+            if (connections[fd].held) {
+                ::close(static_cast<int>(fd));
+            }
+        }
+        ::close(listenFd); 
+        ::close(wakeFd); 
+        if (epollFd >= 0) {
+            ::close(epollFd);
+        }
+        if (!unixPath.empty()) {
+            ::unlink(unixPath.c_str());
+        }
+    }
+
+    IoBackend ioBackend() const {
+        return backend;
+    }
+
+    uint64_t requestsServed() const {
+        return requests.load(std::memory_order_relaxed);
+    }
+
+    int peakConnections() const {
+        return peak.load(std::memory_order_relaxed);
+    }
+
+    // I/O system calls made by the event loop (valid after stop()) 
+    uint64_t ioSyscalls() const {
+#ifdef LFG_HAVE_IO_URING
+        if (backend == IoBackend::Uring) {
+            return ring.syscallCount();
+        }
+#endif
+        return syscalls;
+    }
+
+private: 
+    struct Connection {
+        bool open = false;           // accepting traffic 
+        bool held = false;           // fd not yet closed (io_uring closes once nothing is in flight) 
+        bool writable = true;        // false while waiting for EPOLLOUT 
+        bool outArmed = false;       // EPOLLOUT is in the interest set 
+        bool dirty = false;          // has output queued this wakeup 
+        uint32_t generation = 0;     // bumped on close so stale player owners are ignored 
+        size_t partial = 0;          // bytes of an incomplete frame held in in 
+        std::array<char, sizeof(WireMessage)> in; 
+        std::vector<char> out; 
+        size_t sent = 0; 
+
+        // io_uring only: the receive buffer and the send being written from 
+        bool receiving = false; 
+        bool sending = false; 
+        std::vector<char> received; 
+        std::vector<char> inflight;
+    };
+
+    struct PendingEnqueue {
+        int fd; 
+        uint32_t generation; 
+        uint32_t requestId;
+    };
+
+    void watch(int fd, uint32_t events, int op) {
+        epoll_event event{}; 
+        event.events = events; 
+        event.data.fd = fd; 
+        ::epoll_ctl(epollFd, op, fd, &event); 
+        syscalls++;
+    }
+
+    void wakeUp() {
+        uint64_t one = 1; 
+        ssize_t written = ::write(wakeFd, &one, sizeof(one)); 
+        (void)written;
+    }
+
+    // Work shared by both backends at the end of every wakeup 
+    void afterWakeup() {
+        submitEnqueues(); 
+        deliverMatches(); 
+        flushDirty();
+    }
+
+    void runEpoll() {
+        std::vector<epoll_event> events(1024); 
+        while (running.load(std::memory_order_relaxed)) {
+            int ready = ::epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), -1); 
+            syscalls++; 
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd; 
+                if (fd == listenFd) {
+                    acceptAll();
+                } else if (fd == wakeFd) {
+                    uint64_t count; 
+                    ssize_t got = ::read(wakeFd, &count, sizeof(count)); 
+                    syscalls++; 
+                    (void)got;
+                } else {
+                    if (events[i].events & EPOLLOUT) {
+                        connections[fd].writable = true; 
+                        markDirty(fd);
+                    }
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        readFrom(fd);
+                    }
+                }
+            }
+            afterWakeup();
+        }
+    }
+
+    Connection& adopt(int fd) {
+        if (static_cast<size_t>(fd) >= connections.size()) {
+            connections.resize(fd + 1024);
+        }
+        Connection& connection = connections[fd]; 
+        connection.open = true; 
+        connection.held = true; 
+        connection.writable = true; 
+        connection.outArmed = false; 
+        connection.partial = 0; 
+        connection.out.clear(); 
+        connection.sent = 0; 
+        int open = ++openCount; 
+        if (open > peak.load(std::memory_order_relaxed)) {
+            peak.store(open, std::memory_order_relaxed);
+        }
+        return connection;
+    }
+
+    void acceptAll() {
+        for (;;) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); 
+            syscalls++; 
+            if (fd < 0) {
+                return;
+            }
+            if (unixPath.empty()) {
+                int on = 1; 
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            adopt(fd); 
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void closeConnection(int fd) {
+        Connection& connection = connections[fd]; 
+        if (!connection.open) {
+            return;
+        }
+        connection.open = false; 
+        connection.dirty = false; 
+        connection.generation++; 
+        connection.out.clear(); 
+        openCount--; 
+        if (backend == IoBackend::Epoll) {
+            ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr); 
+            ::close(fd); 
+            syscalls += 2; 
+            connection.held = false; 
+            return;
+        }
+        // Operations still in flight complete (with an error) after shutdown; close after them 
+        ::shutdown(fd, SHUT_RDWR); 
+        releaseIfIdle(fd);
+    }
+
+    void readFrom(int fd) {
+        char buffer[64 * 1024]; 
+        for (;;) {
+            ssize_t got = ::read(fd, buffer, sizeof(buffer)); 
+            syscalls++; 
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (got <= 0) {
+                closeConnection(fd); 
+                return;
+            }
+            consume(fd, buffer, static_cast<size_t>(got)); 
+            if (!connections[fd].open || static_cast<size_t>(got) < sizeof(buffer)) {
+                return;
+            }
+        }
+    }
+
+    // Handle every complete frame in data, keeping a trailing partial frame for next time 
+    void consume(int fd, const char* data, size_t left) {
+        Connection& connection = connections[fd]; 
+        if (connection.partial > 0) {
+            size_t take = std::min(left, sizeof(WireMessage) - connection.partial); 
+            std::memcpy(connection.in.data() + connection.partial, data, take); 
+            connection.partial += take; 
+            data += take; 
+            left -= take; 
+            if (connection.partial < sizeof(WireMessage)) {
+                return;
+            }
+            connection.partial = 0; 
+            handle(fd, connection.in.data());
+        }
+        for (; left >= sizeof(WireMessage) && connection.open; data += sizeof(WireMessage), left -= sizeof(WireMessage)) {
+            handle(fd, data);
+        }
+        if (left > 0 && connection.open) {
+            std::memcpy(connection.in.data(), data, left); 
+            connection.partial = left;
+        }
+    }
+
+    void handle(int fd, const char* frame) {
+        WireMessage request; 
+        std::memcpy(&request, frame, sizeof(request)); 
+        requests.fetch_add(1, std::memory_order_relaxed); 
+
+        WireMessage reply{}; 
+        reply.requestId = request.requestId; 
+        switch (request.type) {
+        case WireEnqueue: 
+            if (request.roleMask > 0 && request.roleMask < RoleMaskCount && request.tier < TierCount) {
+                batch.push_back({request.roleMask, request.tier}); 
+                enqueues.push_back({fd, connections[fd].generation, request.requestId}); 
+                return;
+            }
+            reply.type = WireEnqueued; 
+            reply.playerId = -1; 
+            break; 
+        case WireCancel: 
+            reply.type = WireCancelled; 
+            reply.playerId = request.playerId; 
+            reply.flags = system.cancelPlayer(request.playerId) ? 1 : 0; 
+            break; 
+        case WireStatus: {
+            QueueEstimate estimate = system.getQueueEstimate(request.playerId); 
+            reply.type = WireStatusReply; 
+            reply.playerId = request.playerId; 
+            reply.roleMask = estimate.queued ? static_cast<uint8_t>(estimate.roleMask) : 0; 
+            reply.value = static_cast<int32_t>(std::min<long long>(estimate.position, INT32_MAX)); 
+            reply.extra = static_cast<int32_t>(std::min(estimate.estimatedWaitSeconds * 1000.0, 2e9)); 
+            break;
+        }
+        default: 
+            // Includes the operator requests, which are only served on the admin socket (LFGAdmin) 
+            closeConnection(fd); 
+            return;
+        }
+        send(fd, reply);
+    }
+
+    void send(int fd, const WireMessage& message) {
+        Connection& connection = connections[fd]; 
+        const char* bytes = reinterpret_cast<const char*>(&message); 
+        connection.out.insert(connection.out.end(), bytes, bytes + sizeof(message)); 
+        markDirty(fd);
+    }
+
+    void markDirty(int fd) {
+        if (!connections[fd].dirty) {
+            connections[fd].dirty = true; 
+            dirty.push_back(fd);
+        }
+    }
+
+    // Enqueue everything read this wakeup in one call and remember who owns each new player 
+    void submitEnqueues() {
+        if (batch.empty()) {
+            return;
+        }
+        int firstId = system.addPlayers(std::span<const PlayerRequest>(batch)); 
+        if (owners.size() < static_cast<size_t>(firstId) + batch.size()) {
+            owners.resize(std::max(owners.size() * 2, static_cast<size_t>(firstId) + batch.size()));
+        }
+        for (size_t i = 0; i < enqueues.size(); ++i) {
+            const PendingEnqueue& pending = enqueues[i]; 
+            int playerId = firstId + static_cast<int>(i); 
+            owners[playerId] = Owner{pending.fd, pending.generation}; 
+            if (connections[pending.fd].open && connections[pending.fd].generation == pending.generation) {
+                WireMessage reply{}; 
+                reply.type = WireEnqueued; 
+                reply.requestId = pending.requestId; 
+                reply.playerId = playerId; 
+                send(pending.fd, reply);
+            }
+        }
+        batch.clear(); 
+        enqueues.clear();
+    }
+
+    void deliverMatches() {
+        {
+            std::lock_guard<std::mutex> lock(matchMtx); 
+            if (matches.empty()) {
+                return;
+            }
+            std::swap(matches, delivering);
+        }
+        for (const NoticeRef& notice : delivering) {
+            for (int playerId : notice->players()) {
+                if (playerId < 0 || static_cast<size_t>(playerId) >= owners.size()) {
+                    continue;
+                }
+                Owner owner = owners[playerId]; 
+                if (owner.fd >= 0 && connections[owner.fd].open && connections[owner.fd].generation == owner.generation) {
+                    WireMessage message{}; 
+                    message.type = WireMatched; 
+                    message.playerId = playerId; 
+                    message.value = notice->instanceId + 1; 
+                    send(owner.fd, message);
+                }
+            }
+        }
+        delivering.clear();
+    }
+
+    // One write per connection with queued output; with epoll, leftovers wait for EPOLLOUT 
+    void flushDirty() {
+        for (int fd : dirty) {
+            Connection& connection = connections[fd]; 
+            connection.dirty = false; 
+            if (!connection.open) {
+                continue;
+            }
+#ifdef LFG_HAVE_IO_URING
+            if (backend == IoBackend::Uring) {
+                startSend(fd); 
+                continue;
+            }
+#endif
+            if (!connection.writable) {
+                continue;
+            }
+            if (connection.sent < connection.out.size()) {
+                ssize_t written = ::write(fd, connection.out.data() + connection.sent, connection.out.size() - connection.sent); 
+                syscalls++; 
+                if (written < 0 && errno != EAGAIN && errno != EINTR) {
+                    closeConnection(fd); 
+                    continue;
+                }
+                connection.sent += std::max<ssize_t>(written, 0);
+            }
+            if (connection.sent == connection.out.size()) {
+                connection.out.clear(); 
+                connection.sent = 0; 
+                // Level-triggered EPOLLOUT fires on every wait while armed, so drop it once drained 
+                if (connection.outArmed) {
+                    watch(fd, EPOLLIN, EPOLL_CTL_MOD); 
+                    connection.outArmed = false;
+                }
+            } else {
+                connection.writable = false; 
+                if (!connection.outArmed) {
+                    watch(fd, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD); 
+                    connection.outArmed = true;
+                }
+            }
+        }
+        dirty.clear();
+    }
+
+    void releaseIfIdle(int fd) {
+        Connection& connection = connections[fd]; 
+        if (!connection.open && connection.held && !connection.receiving && !connection.sending) {
+            ::close(fd); 
+            connection.held = false;
+        }
+    }
+
+#ifdef LFG_HAVE_IO_URING
+    // Completion tags: operation kind in the top byte, fd below 
+    enum RingOp : uint64_t { RingAccept = 1, RingRecv = 2, RingSend = 3, RingWake = 4 };
+
+    static uint64_t tag(RingOp op, int fd) {
+        return (static_cast<uint64_t>(op) << 56) | static_cast<uint32_t>(fd);
+    }
+
+    void runUring() {
+        uint64_t wakeCount = 0; 
+        auto armAccept = [this]() {
+            io_uring_sqe& sqe = ring.next(); 
+            sqe.opcode = IORING_OP_ACCEPT; 
+            sqe.fd = listenFd; 
+            sqe.accept_flags = SOCK_CLOEXEC; 
+            sqe.user_data = tag(RingAccept, listenFd);
+        };
+        auto armWake = [this, &wakeCount]() {
+            io_uring_sqe& sqe = ring.next(); 
+            sqe.opcode = IORING_OP_READ; 
+            sqe.fd = wakeFd; 
+            sqe.addr = reinterpret_cast<uint64_t>(&wakeCount); 
+            sqe.len = sizeof(wakeCount); 
+            sqe.user_data = tag(RingWake, wakeFd);
+        };
+        armAccept(); 
+        armWake(); 
+
+        while (running.load(std::memory_order_relaxed)) {
+            if (!ring.submit(1)) {
+                break;
+            }
+            ring.drain([&](const io_uring_cqe& cqe) {
+                int fd = static_cast<int>(cqe.user_data & 0xffffffffu); 
+                switch (static_cast<RingOp>(cqe.user_data >> 56)) {
+                case RingAccept: 
+                    if (cqe.res >= 0) {
+                        if (unixPath.empty()) {
+                            int on = 1; 
+                            ::setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                        }
+                        Connection& connection = adopt(cqe.res); 
+                        connection.received.resize(16 * 1024); 
+                        startReceive(cqe.res);
+                    }
+                    armAccept(); 
+                    break; 
+                case RingRecv: 
+                    connections[fd].receiving = false; 
+                    if (cqe.res > 0 && connections[fd].open) {
+                        consume(fd, connections[fd].received.data(), static_cast<size_t>(cqe.res)); 
+                        startReceive(fd);
+                    } else if (cqe.res != -EINTR && cqe.res != -EAGAIN) {
+                        closeConnection(fd);
+                    } else {
+                        startReceive(fd);
+                    }
+                    releaseIfIdle(fd); 
+                    break; 
+                case RingSend: 
+                    finishSend(fd, cqe.res); 
+                    break; 
+                case RingWake: 
+                    armWake(); 
+                    break;
+                }
+            }); 
+            afterWakeup();
+        }
+    }
+
+    void startReceive(int fd) {
+        Connection& connection = connections[fd]; 
+        if (!connection.open || connection.receiving) {
+            return;
+        }
+        io_uring_sqe& sqe = ring.next(); 
+        sqe.opcode = IORING_OP_RECV; 
+        sqe.fd = fd; 
+        sqe.addr = reinterpret_cast<uint64_t>(connection.received.data()); 
+        sqe.len = static_cast<uint32_t>(connection.received.size()); 
+        sqe.user_data = tag(RingRecv, fd); 
+        connection.receiving = true;
+    }
+
+    // Send everything queued as one operation; output queued meanwhile waits for the next one 
+    void startSend(int fd) {
+        Connection& connection = connections[fd]; 
+        if (connection.sending || connection.out.empty()) {
+            return;
+        }
+        std::swap(connection.out, connection.inflight); 
+        connection.out.clear(); 
+        connection.sent = 0; 
+        connection.sending = true; 
+        queueSend(fd);
+    }
+
+    void queueSend(int fd) {
+        Connection& connection = connections[fd]; 
+        io_uring_sqe& sqe = ring.next(); 
+        sqe.opcode = IORING_OP_SEND; 
+        sqe.fd = fd; 
+        sqe.addr = reinterpret_cast<uint64_t>(connection.inflight.data() + connection.sent); 
+        sqe.len = static_cast<uint32_t>(connection.inflight.size() - connection.sent); 
+        sqe.msg_flags = MSG_NOSIGNAL; 
+        sqe.user_data = tag(RingSend, fd);
+    }
+
+    void finishSend(int fd, int result) {
+        Connection& connection = connections[fd]; 
+        if (result < 0 || !connection.open) {
+            connection.sending = false; 
+            closeConnection(fd); 
+            releaseIfIdle(fd); 
+            return;
+        }
+        connection.sent += static_cast<size_t>(result); 
+        if (connection.sent < connection.inflight.size()) {
+            queueSend(fd); 
+            return;
+        }
+        connection.sending = false; 
+        connection.inflight.clear(); 
+        connection.sent = 0; 
+        startSend(fd);
+    }
+#endif
+
+    struct Owner {
+        int fd = -1; 
+        uint32_t generation = 0;
+    };
+
+    LFGSystem& system; 
+    IoBackend backend = IoBackend::Epoll; 
+    int listenFd = -1; 
+    int epollFd = -1; 
+    int wakeFd = -1; 
+    std::string unixPath; 
+    std::thread loop; 
+    std::atomic<bool> running{false}; 
+#ifdef LFG_HAVE_IO_URING
+    IoRing ring; 
+#endif
+
+    // Owned by the loop thread 
+    std::vector<Connection> connections;     // indexed by fd 
+    std::vector<Owner> owners;               // indexed by player id 
+    std::vector<PlayerRequest> batch; 
+    std::vector<PendingEnqueue> enqueues; 
+    std::vector<int> dirty; 
+    int openCount = 0; 
+    uint64_t syscalls = 0; 
+
+    // Filled by the match listener under the system lock, drained by the loop 
+    std::mutex matchMtx; 
+    std::vector<NoticeRef> matches, delivering; 
+
+    std::atomic<uint64_t> requests{0}; 
+    std::atomic<int> peak{0};
+};
+
+// Operator channel for reconfigure and drain requests, kept off the player-facing front end. 
+// Listens on a Unix socket that only the owner can open, and also checks each peer's uid, so 
+// only the user running the system (or root) can change it. Operator traffic is rare, so one 
+// epoll thread with small blocking-style handling is enough. 
+class LFGAdmin {
+public: 
+    explicit LFGAdmin(LFGSystem& system) : system(system) {}
+
+    ~LFGAdmin() {
+        stop();
+    }
+
+    bool start(const std::string& path) {
+        if (path.find('/') == std::string::npos) {
+            return false;
+        }
+        listenFd = openStreamSocket(path, true); 
+        if (listenFd < 0) {
+            return false;
+        }
+        socketPath = path; 
+        ::chmod(path.c_str(), 0600); 
+        wakeFd = ::eventfd(0, EFD_CLOEXEC); 
+        epollFd = ::epoll_create1(EPOLL_CLOEXEC); 
+        watch(listenFd); 
+        watch(wakeFd); 
+        loop = std::thread([this]() {
+            run();
+        }); 
+        return true;
+    }
+
+    void stop() {
+        if (!loop.joinable()) {
+            return;
+        }
+        uint64_t one = 1; 
+        ssize_t wrote = ::write(wakeFd, &one, sizeof(one)); 
+        (void)wrote; 
+        loop.join(); 
+        for (auto& [fd, client] : clients) {
+            ::close(fd);
+        }
+        clients.clear(); 
+        ::close(listenFd); 
+        ::close(wakeFd); 
+        ::close(epollFd); 
+        ::unlink(socketPath.c_str());
+    }
+
+    // Apply one operator request; returns false for anything that isn't one 
+    static bool handle(LFGSystem& system, const WireMessage& request, WireMessage& reply) {
+        reply = WireMessage{}; 
+        reply.requestId = request.requestId; 
+        switch (request.type) {
+        case WireReconfigure: {
+            RuntimeConfig next = system.settings(); 
+            next.minTime = request.value; 
+            next.maxTime = request.extra; 
+            reply.type = WireReconfigured; 
+            reply.flags = system.reconfigure(next) ? 1 : 0; 
+            return true;
+        }
+        case WireDrain: 
+            reply.type = WireDrained; 
+            reply.value = request.value; 
+            reply.flags = (request.flags ? system.drainInstance(request.value - 1) : system.resumeInstance(request.value - 1)) ? 1 : 0; 
+            reply.extra = system.isDrained(request.value - 1) ? 1 : 0; 
+            return true; 
+        default: 
+            return false;
+        }
+    }
+
+private: 
+    struct Client {
+        std::array<char, sizeof(WireMessage)> in; 
+        size_t partial = 0;
+    };
+
+    void watch(int fd) {
+        epoll_event event{}; 
+        event.events = EPOLLIN; 
+        event.data.fd = fd; 
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void drop(int fd) {
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr); 
+        ::close(fd); 
+        clients.erase(fd);
+    }
+
+    void run() {
+        std::array<epoll_event, 16> events; 
+        for (;;) {
+            int ready = ::epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), -1); 
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd; 
+                if (fd == wakeFd) {
+                    return;
+                }
+                if (fd == listenFd) {
+                    accept();
+                } else {
+                    serve(fd);
+                }
+            }
+        }
+    }
+
+    void accept() {
+        for (;;) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); 
+            if (fd < 0) {
+                return;
+            }
+            ucred peer{}; 
+            socklen_t length = sizeof(peer); 
+            if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || (peer.uid != ::getuid() && peer.uid != 0)) {
+                ::close(fd); 
+                continue;
+            }
+            clients[fd] = Client{}; 
+            watch(fd);
+        }
+    }
+
+    void serve(int fd) {
+        Client& client = clients[fd]; 
+        for (;;) {
+            ssize_t got = ::read(fd, client.in.data() + client.partial, client.in.size() - client.partial); 
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (got <= 0) {
+                drop(fd); 
+                return;
+            }
+            client.partial += static_cast<size_t>(got); 
+            if (client.partial < client.in.size()) {
+                continue;
+            }
+            client.partial = 0; 
+            WireMessage request, reply; 
+            std::memcpy(&request, client.in.data(), sizeof(request)); 
+            // Replies are 20 bytes to a peer that waits for them, so a short write means it is gone 
+            if (!handle(system, request, reply) || ::write(fd, &reply, sizeof(reply)) != static_cast<ssize_t>(sizeof(reply))) {
+                drop(fd); 
+                return;
+            }
+        }
+    }
+
+    LFGSystem& system; 
+    std::string socketPath; 
+    int listenFd = -1; 
+    int wakeFd = -1; 
+    int epollFd = -1; 
+    std::unordered_map<int, Client> clients; 
+    std::thread loop;
+};
+
+// Load generator for the socket front end (run with --loadgen <address> [connections] 
+// [requests per connection] [requests in flight per connection]). One epoll thread keeps a 
+// window of enqueues outstanding on every connection and reports throughput and ack latency. 
+struct LFGLoadGen {
+    struct Result {
+        int connections = 0; 
+        uint64_t requests = 0;       // enqueues sent 
+        uint64_t acked = 0; 
+        uint64_t rejected = 0; 
+        uint64_t matched = 0;        // match notifications received 
+        double seconds = 0.0; 
+        LatencyHistogram ackLatency;
+    };
+
+    static int run(const std::string& address, int connectionCount, int requestsEach, int window) {
+        Result result = drive(address, connectionCount, requestsEach, window); 
+        if (result.connections == 0) {
+            return 1;
+        }
+        std::cout << "Load generator: " << result.connections << " connections x " << requestsEach << " enqueues (window " 
+                  << window << ") to " << address << "\n" << std::fixed 
+                  << "  " << result.acked << " acknowledged in " << std::setprecision(2) << result.seconds << "s: " 
+                  << std::setprecision(0) << result.acked / result.seconds << " requests/s, " << result.rejected 
+                  << " rejected, " << result.matched << " match notifications\n" << std::setprecision(2) 
+                  << "  ack latency avg " << result.ackLatency.meanMs() << "ms, p50 " << result.ackLatency.percentileMs(50) 
+                  << "ms, p99 " << result.ackLatency.percentileMs(99) << "ms, max " << result.ackLatency.maxMs() << "ms\n"; 
+        return result.acked == result.requests ? 0 : 1;
+    }
+
+    // Open the connections, run the load to completion (or a 5s stall) and close them 
+    static Result drive(const std::string& address, int connectionCount, int requestsEach, int window) {
+        raiseFileLimit(); 
+        Result result; 
+        struct Client {
+            int fd = -1; 
+            int sent = 0; 
+            int acked = 0; 
+            size_t partial = 0; 
+            std::array<char, sizeof(WireMessage)> in; 
+            std::vector<int64_t> sentAt;     // by request id 
+        };
+
+        std::vector<Client> clients; 
+        clients.reserve(connectionCount); 
+        for (int i = 0; i < connectionCount; ++i) {
+            int fd = openStreamSocket(address, false); 
+            if (fd < 0) {
+                std::cerr << "Connected " << i << " of " << connectionCount << " clients to " << address << ": " 
+                          << std::strerror(errno) << "\n"; 
+                break;
+            }
+            clients.emplace_back(); 
+            clients.back().fd = fd; 
+            clients.back().sentAt.resize(requestsEach);
+        }
+        result.connections = static_cast<int>(clients.size()); 
+        if (clients.empty()) {
+            return result;
+        }
+
+        int epollFd = ::epoll_create1(EPOLL_CLOEXEC); 
+        for (size_t i = 0; i < clients.size(); ++i) {
+            epoll_event event{}; 
+            event.events = EPOLLIN; 
+            event.data.u64 = i; 
+            ::epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i].fd, &event);
+        }
+
+        // Send up to count enqueues on a client in one write, cycling through a 1/1/3 role mix 
+        auto nowNs = []() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        };
+        auto sendMore = [&](Client& client, int count) {
+            std::array<WireMessage, 64> frames{}; 
+            count = std::min({count, requestsEach - client.sent, static_cast<int>(frames.size())}); 
+            int64_t now = nowNs(); 
+            for (int k = 0; k < count; ++k) {
+                int id = client.sent++; 
+                static constexpr uint8_t mix[] = {roleBit(Tank), roleBit(Healer), roleBit(DPS), roleBit(DPS), roleBit(DPS)}; 
+                frames[k].type = WireEnqueue; 
+                frames[k].roleMask = mix[id % 5]; 
+                frames[k].requestId = static_cast<uint32_t>(id); 
+                client.sentAt[id] = now;
+            }
+            size_t bytes = count * sizeof(WireMessage), done = 0; 
+            while (done < bytes) {
+                ssize_t written = ::write(client.fd, reinterpret_cast<const char*>(frames.data()) + done, bytes - done); 
+                if (written < 0 && errno != EAGAIN && errno != EINTR) {
+                    return;
+                }
+                done += std::max<ssize_t>(written, 0);
+            }
+        };
+
+        auto begin = std::chrono::steady_clock::now(); 
+        for (Client& client : clients) {
+            sendMore(client, window);
+        }
+
+        LatencyHistogram& ackLatency = result.ackLatency; 
+        uint64_t total = static_cast<uint64_t>(clients.size()) * requestsEach, acked = 0, rejected = 0, matched = 0; 
+        std::vector<epoll_event> events(1024); 
+        char buffer[16 * 1024]; 
+        while (acked < total) {
+            int ready = ::epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 5000); 
+            if (ready == 0) {
+                std::cerr << "Timed out with " << (total - acked) << " requests unacknowledged\n"; 
+                break;
+            }
+            for (int i = 0; i < ready; ++i) {
+                Client& client = clients[events[i].data.u64]; 
+                ssize_t got = ::read(client.fd, buffer, sizeof(buffer)); 
+                if (got <= 0) {
+                    continue;
+                }
+                int64_t now = nowNs(); 
+                int newlyAcked = 0; 
+                const char* data = buffer; 
+                size_t left = static_cast<size_t>(got); 
+                while (left > 0) {
+                    size_t take = std::min(left, sizeof(WireMessage) - client.partial); 
+                    std::memcpy(client.in.data() + client.partial, data, take); 
+                    client.partial += take; 
+                    data += take; 
+                    left -= take; 
+                    if (client.partial < sizeof(WireMessage)) {
+                        break;
+                    }
+                    client.partial = 0; 
+                    WireMessage reply; 
+                    std::memcpy(&reply, client.in.data(), sizeof(reply)); 
+                    if (reply.type == WireMatched) {
+                        matched++;
+                    } else if (reply.type == WireEnqueued && reply.requestId < client.sentAt.size()) {
+                        ackLatency.record(now - client.sentAt[reply.requestId]); 
+                        rejected += reply.playerId < 0 ? 1 : 0; 
+                        newlyAcked++;
+                    }
+                }
+                client.acked += newlyAcked; 
+                acked += newlyAcked; 
+                if (newlyAcked > 0) {
+                    sendMore(client, newlyAcked);
+                }
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); 
+        result.requests = total; 
+        result.acked = acked; 
+        result.rejected = rejected; 
+        result.matched = matched; 
+        for (Client& client : clients) {
+            ::close(client.fd);
+        }
+        ::close(epollFd); 
+        return result;
+    }
+};
+#endif
+
+// Matcher micro-benchmarks (run with --bench) 
+struct LFGBenchmark {
+#ifdef LFG_COUNT_ALLOCATIONS
+    static constexpr bool countsAllocations = true; 
+    static uint64_t allocations() { return threadAllocations; }
+#else
+    static constexpr bool countsAllocations = false; 
+    static uint64_t allocations() { return 0; }
+#endif
+
+    // Parties per second formed by claimParty for one template, without dungeon time. 
+    // With groups > 0, that many tank+DPS duos and healer+DPS duos replace solo players. 
+    static double formationRate(const PartyTemplate& party, int parties, int groups = 0) {
+        LFGSystem system(1, 0, 0, party); 
+        system.setLogging(false); 
+        for (int g = 0; g < groups; ++g) {
+            system.addGroup(g % 2 == 0 ? 1 : 0, g % 2 == 0 ? 0 : 1, 1);
+        }
+        int tankGroups = (groups + 1) / 2, healerGroups = groups / 2; 
+        system.addPlayers(party.slots[Tank] * parties - tankGroups, party.slots[Healer] * parties - healerGroups, 
+                          party.slots[DPS] * parties - groups); 
+
+        auto begin = std::chrono::steady_clock::now(); 
+        {
+            std::lock_guard<std::mutex> lock(system.mtx); 
+            LFGSystem::PartyPlan plan; 
+            LFGSystem::FormedParty members; 
+            while (system.planParty(party, plan)) {
+                system.claimParty(plan, members);
+            }
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); 
+        return parties / std::max(elapsed, 1e-9);
+    }
+
+    // Dungeon formation rate after a fifth of the queued players cancelled; also reports ns per cancel 
+    static double cancelHeavyRate(int parties, double& cancelNs) {
+        LFGSystem system(1, 0, 0); 
+        system.setLogging(false); 
+        int tanks = parties * 5 / 4, healers = parties * 5 / 4, dps = parties * 15 / 4; 
+        int firstId = system.addPlayers(tanks, healers, dps); 
+        int total = tanks + healers + dps; 
+
+        auto begin = std::chrono::steady_clock::now(); 
+        for (int id = firstId; id < firstId + total; id += 5) {
+            system.cancelPlayer(id);
+        }
+        cancelNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / (total / 5); 
+
+        int formed = 0; 
+        begin = std::chrono::steady_clock::now(); 
+        {
+            std::lock_guard<std::mutex> lock(system.mtx); 
+            LFGSystem::PartyPlan plan; 
+            LFGSystem::FormedParty members; 
+            while (system.planParty(DungeonParty, plan) && system.claimParty(plan, members)) {
+                formed++;
+            }
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); 
+        return formed / std::max(elapsed, 1e-9);
+    }
+
+    static void run() {
+        const PartyTemplate* templates[] = {&DungeonParty, &SmallDungeonParty, &RaidParty}; 
+        const int parties = 200000; 
+
+        std::cout << "=== Matcher Benchmark (" << parties << " parties per template) ===\n"; 
+        for (const PartyTemplate* party : templates) {
+            double rate = formationRate(*party, parties); 
+            std::cout << std::left << std::setw(14) << party->name << std::right 
+                      << " (" << party->slots[Tank] << "/" << party->slots[Healer] << "/" << party->slots[DPS] << "): " 
+                      << std::fixed << std::setprecision(0) << rate << " parties/s, " 
+                      << rate * party->size() << " players/s\n";
+        }
+
+        // A third of Dungeon players queued as duos 
+        double solo = formationRate(DungeonParty, parties); 
+        double grouped = formationRate(DungeonParty, parties, parties * 5 / 6); 
+        std::cout << "Dungeon with pre-made duos: " << std::fixed << std::setprecision(0) << grouped 
+                  << " parties/s (" << std::setprecision(1) << 100.0 * grouped / solo << "% of solo-only)\n";
+
+        // 20% of queued players cancel before matching 
+        double cancelNs = 0.0; 
+        double cancelled = cancelHeavyRate(parties, cancelNs); 
+        std::cout << "Dungeon with 20% cancellations: " << std::setprecision(0) << cancelled 
+                  << " parties/s (" << std::setprecision(1) << 100.0 * cancelled / solo << "% of no-cancel), " 
+                  << cancelNs << " ns/cancel\n";
+
+        // README "No Healers" case with 10 of the 20 tanks willing to heal 
+        LFGSystem system(1, 0, 0); 
+        system.setLogging(false); 
+        system.addPlayers(10, 5, 30); 
+        system.addFlexPlayers(roleBit(Tank) | roleBit(Healer), 10); 
+        int formed = 0; 
+        {
+            std::lock_guard<std::mutex> lock(system.mtx); 
+            LFGSystem::PartyPlan plan; 
+            LFGSystem::FormedParty members; 
+            while (system.planParty(DungeonParty, plan)) {
+                system.claimParty(plan, members); 
+                formed++;
+            }
+        }
+        std::cout << "No Healers (10 tank/healer flex): " << formed << " parties, " 
+                  << system.flexExtraParties.load() << " more than with fixed roles\n";
+
+        // Gateway-style ingestion: one call per player versus batches of 500 
+        const int ingest = 300000, batchSize = 500; 
+        std::vector<PlayerRequest> batch(batchSize); 
+        for (int i = 0; i < batchSize; ++i) {
+            batch[i].roleMask = static_cast<uint8_t>(roleBit(i < 100 ? Tank : i < 200 ? Healer : DPS));
+        }
+        LFGSystem single(1, 0, 0), bulk(1, 0, 0); 
+        single.setLogging(false); 
+        bulk.setLogging(false); 
+        auto ingestBegin = std::chrono::steady_clock::now(); 
+        for (int i = 0; i < ingest; ++i) {
+            single.addPlayers(i % 5 == 0, i % 5 == 1, i % 5 >= 2);
+        }
+        auto ingestMid = std::chrono::steady_clock::now(); 
+        for (int i = 0; i < ingest; i += batchSize) {
+            bulk.addPlayers(std::span<const PlayerRequest>(batch));
+        }
+        auto ingestEnd = std::chrono::steady_clock::now(); 
+        std::cout << "Ingestion: " << std::setprecision(1) 
+                  << std::chrono::duration<double, std::nano>(ingestMid - ingestBegin).count() / ingest << " ns/player one at a time, " 
+                  << std::chrono::duration<double, std::nano>(ingestEnd - ingestMid).count() / ingest << " ns/player in batches of " 
+                  << batchSize << "\n"; 
+
+#ifdef LFG_COUNT_ALLOCATIONS
+        // Heap allocations per party once warm: claim, write the notice, log it (logging off) and 
+        // start the party with metrics on and a listener holding the last 64 notices 
+        {
+            const int warmParties = 1000, countedParties = 100000, total = warmParties + countedParties; 
+            LFGSystem steady(1, 0, 0); 
+            steady.setLogging(false); 
+            std::array<NoticeRef, 64> held; 
+            size_t heldNext = 0; 
+            steady.setMatchListener([&held, &heldNext](const NoticeRef& notice) {
+                held[heldNext++ % held.size()] = notice;
+            }); 
+            steady.addPlayers(total, total, total * 3); 
+            uint64_t before = 0; 
+            for (int i = 0; i < total; ++i) {
+                if (i == warmParties) {
+                    before = threadAllocations;
+                }
+                std::lock_guard<std::mutex> lock(steady.mtx); 
+                LFGSystem::PartyPlan plan; 
+                LFGSystem::FormedParty members; 
+                steady.planParty(DungeonParty, plan); 
+                steady.claimParty(plan, members); 
+                NoticeRef notice = steady.publishParty(0, members); 
+                steady.logFormed(*notice); 
+                steady.startParty(0, notice);
+            }
+            std::cout << "Heap allocations per formed party: " << std::setprecision(3) 
+                      << static_cast<double>(threadAllocations - before) / countedParties << "\n";
+        }
+#else
+        std::cout << "Heap allocations not counted (build with -DLFG_COUNT_ALLOCATIONS to check them)\n"; 
+#endif
+
+        // Full cycle per party once warm: batch enqueue, form, run a zero-length dungeon and 
+        // complete it, with logging on (console output discarded) 
+        {
+            struct NullBuffer : std::streambuf {
+                int overflow(int c) override { return c; }
+                std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+            }; 
+            NullBuffer discard; 
+            const int warmParties = 1000, countedParties = 100000, total = warmParties + countedParties; 
+            const std::array<PlayerRequest, 5> party{{{roleBit(Tank)}, {roleBit(Healer)}, {roleBit(DPS)}, {roleBit(DPS)}, {roleBit(DPS)}}}; 
+            LFGSystem cycle(1, 0, 0); 
+            cycle.reservePlayers(total * 5); 
+            cycle.instancesWaiting = 1; 
+            std::streambuf* console = std::cout.rdbuf(&discard); 
+            uint64_t before = 0; 
+            int formed = 0; 
+            for (int i = 0; i < total; ++i) {
+                if (i == warmParties) {
+                    before = allocations();
+                }
+                cycle.addPlayers(std::span<const PlayerRequest>(party)); 
+                if (cycle.tryFormParty(0)) {
+                    cycle.runDungeon(0); 
+                    formed++;
+                }
+            }
+            std::cout.rdbuf(console); 
+            if (countsAllocations) {
+                std::cout << "Heap allocations per party formed and completed (with ingestion, logging on): " 
+                          << std::setprecision(3) << static_cast<double>(allocations() - before) / countedParties 
+                          << " (" << formed << "/" << total << " formed)\n";
+            }
+            std::cout << "Stage latency in that cycle (p50/p99):" << std::setprecision(2); 
+            for (int stage = 0; stage < LFGSystem::StageCount; ++stage) {
+                const LatencyHistogram& latency = cycle.stageLatency[stage]; 
+                std::cout << (stage == 0 ? " " : ", ") << LFGSystem::stageNames[stage] << " " << latency.percentileMs(50) * 1e3 
+                          << "/" << latency.percentileMs(99) * 1e3 << "us";
+            }
+            std::cout << "\n";
+        }
+
+        // Full cycle quiet, with another thread waking every millisecond, and with that thread also 
+        // reconfiguring each time. Readers only copy the current settings, so the cost of live 
+        // reconfiguration is the difference between the last two. 
+        {
+            const int reconfigParties = 200000; 
+            const std::array<PlayerRequest, 5> party{{{roleBit(Tank)}, {roleBit(Healer)}, {roleBit(DPS)}, {roleBit(DPS)}, {roleBit(DPS)}}}; 
+            enum Churn { Quiet, Wakeups, Reconfigures }; 
+            auto runCycle = [&](Churn churn, int& reconfigs) {
+                LFGSystem cycle(1, 0, 0); 
+                cycle.setLogging(false); 
+                cycle.reservePlayers(reconfigParties * 5); 
+                cycle.instancesWaiting = 1; 
+                std::atomic<bool> done{false}; 
+                reconfigs = 0; 
+                std::thread reconfigurer; 
+                if (churn != Quiet) {
+                    reconfigurer = std::thread([&]() {
+                        RuntimeConfig next = cycle.settings(); 
+                        while (!done.load()) {
+                            next.backfill.leaveRate = next.backfill.leaveRate > 0.0 ? 0.0 : 1e-9; 
+                            if (churn == Reconfigures) {
+                                cycle.reconfigure(next); 
+                                reconfigs++;
+                            }
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                    });
+                }
+                auto begin = std::chrono::steady_clock::now(); 
+                auto last = begin; 
+                std::chrono::steady_clock::duration longestGap{}; 
+                for (int i = 0; i < reconfigParties; ++i) {
+                    cycle.addPlayers(std::span<const PlayerRequest>(party)); 
+                    if (cycle.tryFormParty(0)) {
+                        cycle.runDungeon(0);
+                    }
+                    auto now = std::chrono::steady_clock::now(); 
+                    longestGap = std::max(longestGap, now - last); 
+                    last = now;
+                }
+                double seconds = std::chrono::duration<double>(last - begin).count(); 
+                done.store(true); 
+                if (reconfigurer.joinable()) {
+                    reconfigurer.join();
+                }
+                return std::pair<double, double>(reconfigParties / seconds, std::chrono::duration<double, std::micro>(longestGap).count());
+            }; 
+            // Best of three interleaved rounds, so a noisy moment on a shared core hits every mode alike 
+            int reconfigs = 0; 
+            double steadyRate = 0, steadyGap = 0, wakeRate = 0, wakeGap = 0, churnRate = 0, churnGap = 0; 
+            for (int round = 0; round < 3; ++round) {
+                for (Churn churn : {Quiet, Wakeups, Reconfigures}) {
+                    auto [rate, gap] = runCycle(churn, reconfigs); 
+                    double& bestRate = churn == Quiet ? steadyRate : churn == Wakeups ? wakeRate : churnRate; 
+                    double& bestGap = churn == Quiet ? steadyGap : churn == Wakeups ? wakeGap : churnGap; 
+                    if (rate > bestRate) {
+                        bestRate = rate; 
+                        bestGap = gap;
+                    }
+                }
+            }
+            std::cout << std::setprecision(2) << "Cycle: " << steadyRate / 1e6 << "M parties/s quiet (longest gap " 
+                      << std::setprecision(0) << steadyGap << "us), " << std::setprecision(2) << wakeRate / 1e6 
+                      << "M with a thread waking every 1ms (" << std::setprecision(0) << wakeGap << "us), " 
+                      << std::setprecision(2) << churnRate / 1e6 << "M with it reconfiguring too (" << reconfigs 
+                      << " reconfigs, " << std::setprecision(0) << churnGap << "us)\n";
+        }
+
+        // stop() latency: idle workers sitting in their backoff, and 5s dungeons aborted part way 
+        {
+            auto timeStop = [](LFGSystem& system, StopMode mode) {
+                auto begin = std::chrono::steady_clock::now(); 
+                system.stop(mode); 
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            }; 
+            LFGSystem idle(4, 0, 0); 
+            idle.setLogging(false); 
+            idle.start(); 
+            std::this_thread::sleep_for(std::chrono::milliseconds(20)); 
+            double idleMs = timeStop(idle, StopMode::FinishInFlight); 
+
+            LFGSystem busy(2, 5, 5); 
+            busy.setLogging(false); 
+            busy.start(); 
+            busy.addPlayers(2, 2, 6); 
+            for (int waited = 0; busy.activeInstances.load() < 2 && waited < 2000; ++waited) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            double abortMs = timeStop(busy, StopMode::Abort); 
+            std::cout << std::setprecision(2) << "stop() with idle workers: " << idleMs << "ms, aborting " 
+                      << busy.dungeonsAborted.load() << " running 5s dungeons: " << abortMs << "ms\n";
+        }
+
+        // Formation with the WAL on (group commit) versus off 
+        {
+            const char* walPath = "lfg_bench.wal"; 
+            std::remove(walPath); 
+            const int walParties = 100000; 
+            LFGSystem logged(1, 0, 0); 
+            logged.setLogging(false); 
+            logged.openWal(walPath); 
+            logged.addPlayers(walParties, walParties, walParties * 3); 
+            auto walBegin = std::chrono::steady_clock::now(); 
+            uint64_t lastLsn = 0; 
+            {
+                std::lock_guard<std::mutex> lock(logged.mtx); 
+                LFGSystem::PartyPlan plan; 
+                LFGSystem::FormedParty members; 
+                while (logged.planParty(DungeonParty, plan) && logged.claimParty(plan, members)) {
+                    lastLsn = logged.logPartyStarted(0, *logged.publishParty(0, members));
+                }
+            }
+            logged.wal->waitDurable(lastLsn); 
+            double walSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - walBegin).count(); 
+            double offRate = formationRate(DungeonParty, walParties); 
+            std::cout << "WAL on: " << std::setprecision(0) << walParties / walSeconds << " parties/s vs " << offRate 
+                      << " off (" << std::setprecision(2) << (walSeconds / walParties - 1.0 / offRate) * 1e6 
+                      << " us/party durability cost, " << logged.wal->syncs() << " fsyncs)\n"; 
+
+            logged.wal->close(); 
+            std::remove(walPath); 
+
+            // Without group commit: wait for each entry before forming the next party, with the 
+            // writer using write() + fdatasync() or one io_uring submission per batch 
+            for (bool useRing : {false, true}) {
+                const int syncParties = 200; 
+                LFGSystem synced(1, 0, 0); 
+                synced.setLogging(false); 
+                synced.openWal(walPath, useRing); 
+                synced.addPlayers(syncParties, syncParties, syncParties * 3); 
+                auto syncBegin = std::chrono::steady_clock::now(); 
+                for (int i = 0; i < syncParties; ++i) {
+                    uint64_t lsn; 
+                    {
+                        std::lock_guard<std::mutex> lock(synced.mtx); 
+                        LFGSystem::PartyPlan plan; 
+                        LFGSystem::FormedParty members; 
+                        synced.planParty(DungeonParty, plan); 
+                        synced.claimParty(plan, members); 
+                        lsn = synced.logPartyStarted(0, *synced.publishParty(0, members));
+                    }
+                    synced.wal->waitDurable(lsn);
+                }
+                double syncSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - syncBegin).count(); 
+                std::cout << "WAL with one fsync per party (" << (useRing ? "io_uring" : "write+fdatasync") << "): " 
+                          << std::setprecision(2) << syncSeconds / syncParties * 1e6 << " us/party\n"; 
+                synced.wal->close(); 
+                std::remove(walPath);
+            }
+        }
+
+#ifdef LFG_HAVE_MMAP
+        // Restart from a memory-mapped state file holding a million queued players 
+        {
+            const char* statePath = "lfg_bench.state"; 
+            std::remove(statePath); 
+            {
+                LFGSystem before(4, 1, 1); 
+                before.setLogging(false); 
+                before.attachState(statePath); 
+                std::vector<PlayerRequest> million(1000000); 
+                for (size_t i = 0; i < million.size(); ++i) {
+                    million[i].roleMask = static_cast<uint8_t>(roleBit(i % 5 == 0 ? Tank : i % 5 == 1 ? Healer : DPS));
+                }
+                before.addPlayers(std::span<const PlayerRequest>(million));
+            }
+            LFGSystem after(4, 1, 1); 
+            after.setLogging(false); 
+            auto restartBegin = std::chrono::steady_clock::now(); 
+            after.attachState(statePath); 
+            double restartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - restartBegin).count(); 
+            int tanks, healers, dps; 
+            after.getRemainingPlayers(tanks, healers, dps); 
+            std::cout << "Restart from state file: " << (tanks + healers + dps) << " queued players restored in " 
+                      << std::setprecision(1) << restartMs << " ms (queue rebuild " << after.recoveryMs << " ms)\n"; 
+            std::remove(statePath);
+        }
+#endif
+
+        // Cost of the lock-free position query against a deep queue 
+        LFGSystem queued(4, 1, 1); 
+        queued.setLogging(false); 
+        int queuedPlayers = queued.addPlayers(0, 0, 100000) + 100000; 
+        const int queries = 1000000; 
+        volatile double sink = 0.0; 
+        auto begin = std::chrono::steady_clock::now(); 
+        for (int i = 0; i < queries; ++i) {
+            sink = queued.getQueueEstimate(i % queuedPlayers).estimatedWaitSeconds;
+        }
+        double queryNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / queries; 
+        std::cout << "Queue position query: " << std::setprecision(1) << queryNs << " ns/query\n"; 
+        (void)sink;
+
+        // Metrics export walks every shard, so it should stay cheap enough to scrape often 
+        const int exports = 1000; 
+        size_t bytes = 0; 
+        begin = std::chrono::steady_clock::now(); 
+        for (int i = 0; i < exports; ++i) {
+            bytes += queued.exportMetrics(i % 2 == 1).size();
+        }
+        double exportUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / exports; 
+        std::cout << "Metrics export: " << std::setprecision(1) << exportUs << " us/export (" << bytes / exports << " bytes)\n";
+
+#ifdef LFG_HAVE_EPOLL
+        // The same client load through each front-end I/O backend 
+        for (IoBackend backend : {IoBackend::Epoll, IoBackend::Uring}) {
+            const char* socketPath = "./lfg_bench.sock"; 
+            LFGSystem served(1, 0, 0); 
+            served.setLogging(false); 
+            LFGServer server(served); 
+            if (!server.start(socketPath, backend)) {
+                continue;
+            }
+            LFGLoadGen::Result load = LFGLoadGen::drive(socketPath, 4000, 50, 4); 
+            server.stop(); 
+            std::cout << "Front end (" << (server.ioBackend() == IoBackend::Uring ? "io_uring" : "epoll") << "): " 
+                      << load.connections << " connections, " << std::setprecision(0) << load.acked / load.seconds 
+                      << " requests/s, ack p99 " << std::setprecision(2) << load.ackLatency.percentileMs(99) << "ms, " 
+                      << static_cast<double>(server.ioSyscalls()) / std::max<uint64_t>(server.requestsServed(), 1) 
+                      << " server syscalls/request\n";
+        }
+#endif
+
+    }
+};
+
+// Feeds a recorded trace back through the matcher (run with --replay <file> [--realtime]) 
+struct LFGReplay {
+    // Party templates of the recorded instances; names point into templates, which must outlive them 
+    static std::vector<PartyTemplate> recordedParties(const TraceHeader& header, const std::vector<TraceTemplate>& templates) {
+        std::vector<PartyTemplate> parties(header.instances, DungeonParty); 
+        for (size_t i = 0; i < templates.size(); ++i) {
+            parties[i].name = templates[i].name; 
+            for (int r = 0; r < RoleCount; ++r) {
+                parties[i].slots[r] = templates[i].slots[r];
+            }
+        }
+        return parties;
+    }
+
+    // Recorded first id of each replayed enqueue run -> (first id it got in the replay, players) 
+    using IdRuns = std::map<int, std::pair<int, int>>; 
+
+    // Apply one input event (enqueue, group, cancel); outputs of the original run are skipped. 
+    // Replayed players get fresh ids, so a cancel is mapped through the run that enqueued the 
+    // player; one for a player enqueued before recording started is dropped. 
+    static void apply(LFGSystem& system, const TraceRecord& record, IdRuns& runs) {
+        switch (record.type) {
+        case TraceEnqueue: {
+            PlayerRequest request{record.roleMask, record.tier}; 
+            std::vector<PlayerRequest> batch(record.value, request); 
+            runs[record.id] = {system.addPlayers(std::span<const PlayerRequest>(batch)), record.value}; 
+            break;
+        }
+        case TraceGroup: {
+            auto shape = shapeOf(record.value); 
+            system.addGroup(shape[Tank], shape[Healer], shape[DPS]); 
+            break;
+        }
+        case TraceCancel: {
+            auto run = runs.upper_bound(record.id); 
+            if (run != runs.begin() && record.id - std::prev(run)->first < std::prev(run)->second.second) {
+                --run; 
+                system.cancelPlayer(run->second.first + (record.id - run->first));
+            }
+            break;
+        }
+        default: 
+            break;
+        }
+    }
+
+    static int run(const std::string& path, bool realtime) {
+        TraceHeader header; 
+        std::vector<TraceTemplate> templates; 
+        std::vector<TraceRecord> records; 
+        bool truncated = false; 
+        if (!loadTrace(path, header, templates, records, truncated)) {
+            std::cerr << "Cannot read trace " << path << "\n"; 
+            return 1;
+        }
+        if (truncated) {
+            std::cerr << "Trace " << path << " ends in a partial record; replaying the " << records.size() << " whole ones\n";
+        }
+        // Runs of instances serving the same template, e.g. "2x Dungeon 1/1/3" 
+        std::vector<PartyTemplate> recorded = recordedParties(header, templates); 
+        std::ostringstream served; 
+        for (size_t i = 0, run = 1; i < recorded.size(); ++i, ++run) {
+            const PartyTemplate& party = recorded[i]; 
+            if (i + 1 < recorded.size() && std::strcmp(recorded[i + 1].name, party.name) == 0 && recorded[i + 1].slots == party.slots) {
+                continue;
+            }
+            served << (served.tellp() > 0 ? ", " : "") << run << "x " << party.name << " " << party.slots[Tank] << "/" 
+                   << party.slots[Healer] << "/" << party.slots[DPS]; 
+            run = 0;
+        }
+
+        int recordedParties = 0; 
+        for (const auto& record : records) {
+            recordedParties += record.type == TraceFormed;
+        }
+        std::cout << "=== Replaying " << records.size() << " events (" << header.instances << " instances, " 
+                  << header.minTime << "-" << header.maxTime << "s, " << (realtime ? "real time" : "max speed") << ") ===\n" 
+                  << "Instance templates: " << served.str() << "\n"; 
+
+        LFGSystem system(0, header.minTime, header.maxTime); 
+        for (const PartyTemplate& party : recorded) {
+            system.addInstances(1, party);
+        }
+        auto begin = std::chrono::steady_clock::now(); 
+        int parties = 0; 
+        IdRuns runs; 
+
+        if (realtime) {
+            // Same timing as the original run, with instance threads and dungeon times 
+            system.start(); 
+            for (const auto& record : records) {
+                std::this_thread::sleep_until(begin + std::chrono::nanoseconds(record.timestampNs)); 
+                apply(system, record, runs);
+            }
+            system.waitForCompletion(); 
+            system.stop(); 
+            system.displaySummary(); 
+            parties = system.totalPartiesFormed.load();
+        } else {
+            // Matcher only: inputs back to back, every instance always free 
+            system.setLogging(false); 
+            LFGSystem::PartyPlan plan; 
+            LFGSystem::FormedParty members; 
+            for (const auto& record : records) {
+                apply(system, record, runs); 
+                std::lock_guard<std::mutex> lock(system.mtx); 
+                for (int i = 0; i < system.maxInstances; ++i) {
+                    const PartyTemplate& party = *system.instances[i].party; 
+                    while (system.planParty(party, plan) && system.claimParty(plan, members)) {
+                        parties++;
+                    }
+                }
+            }
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); 
+        std::cout << "Replayed in " << std::fixed << std::setprecision(3) << elapsed << "s (" << std::setprecision(0) 
+                  << records.size() / std::max(elapsed, 1e-9) << " events/s): " << parties << " parties formed, " 
+                  << recordedParties << " in the recording\n"; 
+        return 0;
+    }
+};
+
+// Capacity planner (run with --plan <tanks/s> <healers/s> <DPS/s> <t1> <t2> <p99 wait SLO in s>). 
+// A discrete-event simulation in virtual time of Poisson arrivals per role and uniform t1..t2 
+// dungeon runs; instance counts are tried in parallel, one simulation per thread, and the 
+// smallest count meeting the SLO is reported. The SLO applies to the time a complete party 
+// waits for a free instance: the time spent waiting for the other roles to arrive is shown 
+// alongside, but no instance count can shorten it. 
+struct LFGPlanner {
+    struct Scenario {
+        std::array<double, RoleCount> arrivalRate{};   // players per second 
+        int minTime = 1; 
+        int maxTime = 15; 
+        const PartyTemplate* party = &DungeonParty; 
+        int warmupParties = 20000;   // formed before waits are measured 
+        int parties = 200000;        // measured 
+        uint64_t seed = 1;
+    };
+
+    struct Outcome {
+        int instances = 0; 
+        LatencyHistogram instanceWait;   // per party, virtual nanoseconds 
+        LatencyHistogram playerWait;     // per player, enqueue to dungeon start 
+        double utilization = 0.0;
+    };
+
+    // Parties per second the arrival mix can fill (limited by the scarcest role) 
+    static double partyRate(const Scenario& scenario) {
+        double rate = std::numeric_limits<double>::infinity(); 
+        for (int r = 0; r < RoleCount; ++r) {
+            if (scenario.party->slots[r] > 0) {
+                rate = std::min(rate, scenario.arrivalRate[r] / scenario.party->slots[r]);
+            }
+        }
+        return rate;
+    }
+
+    // Roles arriving faster than parties can use them queue without bound whatever the instance count 
+    static bool surplus(const Scenario& scenario, int role) {
+        return scenario.party->slots[role] > 0 && scenario.arrivalRate[role] / scenario.party->slots[role] > partyRate(scenario) * 1.02;
+    }
+
+    static Outcome simulate(const Scenario& scenario, int instances) {
+        Outcome outcome; 
+        outcome.instances = instances; 
+        std::mt19937_64 gen(scenario.seed * 0x9E3779B97F4A7C15ull + instances); 
+        std::uniform_int_distribution<> duration(scenario.minTime, scenario.maxTime); 
+        const double never = std::numeric_limits<double>::infinity(); 
+
+        std::array<std::exponential_distribution<double>, RoleCount> gap; 
+        std::array<double, RoleCount> nextArrival; 
+        for (int r = 0; r < RoleCount; ++r) {
+            nextArrival[r] = never; 
+            if (scenario.arrivalRate[r] > 0.0) {
+                gap[r] = std::exponential_distribution<double>(scenario.arrivalRate[r]); 
+                nextArrival[r] = gap[r](gen);
+            }
+        }
+
+        std::array<RingQueue<double>, RoleCount> queued;   // arrival times 
+        std::priority_queue<double, std::vector<double>, std::greater<double>> busyUntil; 
+        const auto& slots = scenario.party->slots; 
+        int idle = instances, formed = 0; 
+        const int total = scenario.warmupParties + scenario.parties; 
+        double now = 0.0, measuredFrom = 0.0, busySeconds = 0.0; 
+
+        while (formed < total) {
+            // Next event: an arrival or an instance finishing, whichever is first 
+            int role = static_cast<int>(std::min_element(nextArrival.begin(), nextArrival.end()) - nextArrival.begin()); 
+            if (!busyUntil.empty() && busyUntil.top() <= nextArrival[role]) {
+                now = busyUntil.top(); 
+                busyUntil.pop(); 
+                idle++;
+            } else if (nextArrival[role] == never) {
+                break;
+            } else {
+                now = nextArrival[role]; 
+                queued[role].push_back(now); 
+                nextArrival[role] = now + gap[role](gen);
+            }
+
+            // Fill every idle instance the queues allow 
+            while (idle > 0) {
+                bool enough = true; 
+                for (int r = 0; r < RoleCount; ++r) {
+                    enough &= queued[r].size() >= static_cast<size_t>(slots[r]);
+                }
+                if (!enough) {
+                    break;
+                }
+                bool measured = formed >= scenario.warmupParties; 
+                if (formed == scenario.warmupParties) {
+                    measuredFrom = now;
+                }
+                double complete = 0.0;   // when the last member arrived 
+                for (int r = 0; r < RoleCount; ++r) {
+                    for (int k = 0; k < slots[r]; ++k) {
+                        complete = std::max(complete, queued[r].front()); 
+                        if (measured) {
+                            outcome.playerWait.record(static_cast<int64_t>((now - queued[r].front()) * 1e9));
+                        }
+                        queued[r].pop_front();
+                    }
+                }
+                if (measured) {
+                    outcome.instanceWait.record(static_cast<int64_t>((now - complete) * 1e9));
+                }
+                int seconds = duration(gen); 
+                busyUntil.push(now + seconds); 
+                idle--; 
+                formed++; 
+                if (measured) {
+                    busySeconds += seconds;
+                }
+            }
+        }
+
+        double elapsed = now - measuredFrom; 
+        outcome.utilization = elapsed > 0.0 ? std::min(1.0, busySeconds / (instances * elapsed)) : 0.0; 
+        return outcome;
+    }
+
+    // Largest instance count the sweep tries for an offered load (in Erlangs) 
+    static int sweepLimit(double offered) {
+        return (static_cast<int>(std::floor(offered)) + 1) * 4 + 64;
+    }
+
+    // Try instance counts upward, one block of hardware threads at a time; returns the smallest 
+    // count meeting the SLO, or -1 
+    static int plan(const Scenario& scenario, double sloSeconds, bool print) {
+        double rate = partyRate(scenario); 
+        if (!(rate > 0.0) || std::isinf(rate)) {
+            return -1;
+        }
+        // Fewer instances than the offered load can never keep up 
+        double offered = rate * (scenario.minTime + scenario.maxTime) / 2.0; 
+        int first = static_cast<int>(std::floor(offered)) + 1, limit = sweepLimit(offered); 
+        int workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); 
+
+        for (int base = first; base <= limit; base += workers) {
+            int count = std::min(workers, limit - base + 1); 
+            std::vector<std::unique_ptr<Outcome>> outcomes(count); 
+            std::vector<std::thread> threads; 
+            for (int i = 0; i < count; ++i) {
+                threads.emplace_back([&scenario, &outcomes, base, i]() {
+                    outcomes[i] = std::make_unique<Outcome>(simulate(scenario, base + i));
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+
+            for (const auto& outcome : outcomes) {
+                double p99 = outcome->instanceWait.percentileMs(99) / 1e3; 
+                if (print) {
+                    std::cout << "  n = " << std::setw(4) << outcome->instances << ": p99 instance wait " << std::fixed 
+                              << std::setprecision(2) << std::setw(7) << p99 << "s, p99 player wait " << std::setw(7) 
+                              << outcome->playerWait.percentileMs(99) / 1e3 << "s, utilization " << std::setprecision(1) 
+                              << outcome->utilization * 100.0 << "%\n";
+                }
+                if (p99 <= sloSeconds) {
+                    return outcome->instances;
+                }
+            }
+        }
+        return -1;
+    }
 
-    // Player queues 
-    std::queue<int> tankQueue; 
-    std::queue<int> healerQueue; 
-    std::queue<int> dpsQueue; 
+    static int run(const Scenario& scenario, double sloSeconds) {
+        double rate = partyRate(scenario); 
+        if (!(rate > 0.0) || std::isinf(rate) || scenario.minTime < 0 || scenario.maxTime < scenario.minTime || sloSeconds < 0.0) {
+            std::cerr << "Planner needs a positive arrival rate for every role in the party, 0 <= t1 <= t2 and a non-negative SLO\n"; 
+            return 1;
+        }
 
-    // Instance management 
-    struct Instance {
-        int id; 
-        std::string status; 
-        int partiesServed; 
-        int totalTimeServed; 
-        bool active; 
-        std::thread thread;
+        double offered = rate * (scenario.minTime + scenario.maxTime) / 2.0; 
+        std::cout << "=== Capacity Plan: " << scenario.party->name << " parties, " << scenario.minTime << "-" << scenario.maxTime 
+                  << "s runs, p99 instance wait <= " << sloSeconds << "s ===\n" << std::fixed << std::setprecision(2) 
+                  << "SLO: p99 instance-queue wait, the time a complete party waits for a free instance. Player wait " 
+                  << "(for the other roles to arrive) is shown but not part of it.\n" 
+                  << "Party rate " << rate << "/s, offered load " << offered << " instances\n"; 
+        for (int r = 0; r < RoleCount; ++r) {
+            if (surplus(scenario, r)) {
+                std::cout << roleNames[r] << " arrive faster than parties can use them and will queue without bound\n";
+            }
+        }
 
-        Instance(int i) : id(i), status("empty"), partiesServed(0), totalTimeServed(0), active(false) {} 
-    }; 
+        auto begin = std::chrono::steady_clock::now(); 
+        int instances = plan(scenario, sloSeconds, true); 
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); 
+        if (instances < 0) {
+            std::cout << "No instance count up to " << sweepLimit(offered) << " meets the instance-queue wait SLO\n"; 
+            return 1;
+        }
+        std::cout << "Minimum instances: " << instances << " for p99 instance-queue wait <= " << std::setprecision(2) << sloSeconds 
+                  << "s (planned in " << elapsed << "s)\n"; 
+        return 0;
+    }
+};
 
-    std::vector<Instance> instances; 
-    // std::vector<std::thread> instanceThreads; 
+// Monte Carlo batch runner (run with --batch <runs> [n t h d t1 t2 [seed]]). Each run replays an 
+// interactive session in virtual time: t/h/d players queued up front, n instances, dungeon runs 
+// drawn from t1..t2 and each party going to a random idle instance, standing in for whichever 
+// thread the OS wakes first. Runs are independent tasks pulled by a pool of hardware threads, 
+// each writing only its own result. Without a configuration the README test cases are run. 
+struct LFGBatch {
+    struct Config {
+        std::string name; 
+        int instances; 
+        int tanks; 
+        int healers; 
+        int dps; 
+        int minTime; 
+        int maxTime;
+    };
 
-    // Statistics 
-    std::atomic<int> totalPartiesFormed{0}; 
-    std::atomic<bool> running{true}; 
-    std::atomic<int> instancesWaiting{0};
+    struct Result {
+        int parties = 0; 
+        double fairness = 0.0; 
+        double completionSeconds = 0.0;   // until the last dungeon finished 
+    };
 
-    // Configuration 
-    int maxInstances; 
-    int t1, t2;
+    // Pause an instance takes after each dungeon before looking for its next party 
+    static constexpr double BackoffSeconds = 0.05; 
 
-    // Random number generation 
-    std::random_device rd; 
-    std::mt19937 gen; 
+    static Result simulate(const Config& config, uint64_t seed) {
+        std::mt19937_64 gen(seed); 
+        std::uniform_int_distribution<> duration(config.minTime, config.maxTime); 
+        std::array<int, RoleCount> queued{config.tanks, config.healers, config.dps}; 
+        const auto& slots = DungeonParty.slots; 
 
-    // Get current timestamp string 
-    std::string get_timestamp() {
-        auto now = std::chrono::system_clock::now(); 
-        auto in_time_t = std::chrono::system_clock::to_time_t(now); 
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now.time_since_epoch()) % 1000; 
-        
-        std::stringstream ss; 
-        ss << std::put_time(std::localtime(&in_time_t), "%H:%M:%S"); 
-        ss << "." << std::setfill('0') << std::setw(3) << ms.count(); 
-        return ss.str();
+        std::vector<int> served(config.instances, 0), idle(config.instances); 
+        std::iota(idle.begin(), idle.end(), 0); 
+        using Ready = std::pair<double, int>;   // time the instance is free again, instance 
+        std::priority_queue<Ready, std::vector<Ready>, std::greater<Ready>> busy; 
+        Result result; 
+        double now = 0.0; 
+
+        while (true) {
+            // Hand parties to random idle instances while the queues can fill them 
+            while (!idle.empty()) {
+                bool enough = true; 
+                for (int r = 0; r < RoleCount; ++r) {
+                    enough &= queued[r] >= slots[r];
+                }
+                if (!enough) {
+                    break;
+                }
+                for (int r = 0; r < RoleCount; ++r) {
+                    queued[r] -= slots[r];
+                }
+                size_t pick = std::uniform_int_distribution<size_t>(0, idle.size() - 1)(gen); 
+                int instance = idle[pick]; 
+                idle[pick] = idle.back(); 
+                idle.pop_back(); 
+                served[instance]++; 
+                result.parties++; 
+                double finished = now + duration(gen); 
+                result.completionSeconds = std::max(result.completionSeconds, finished); 
+                busy.emplace(finished + BackoffSeconds, instance);
+            }
+            if (busy.empty()) {
+                break;
+            }
+            now = busy.top().first; 
+            while (!busy.empty() && busy.top().first == now) {
+                idle.push_back(busy.top().second); 
+                busy.pop();
+            }
+        }
+        result.fairness = fairnessOf(served); 
+        return result;
     }
 
-    // Synchronized output function 
-    void synchronized_print(const std::string& message) {
-        std::lock_guard<std::mutex> cout_lock(cout_mtx); 
-        // std::cout << message << std::endl; 
-        std::cout << "[" << get_timestamp() << "] " << message << std::endl;
+    // Value at fraction q (0..1) of sorted samples 
+    static double quantile(const std::vector<double>& sorted, double q) {
+        return sorted.empty() ? 0.0 : sorted[static_cast<size_t>(q * (sorted.size() - 1) + 0.5)];
     }
 
-public: 
-    LFGSystem(int n, int minTime, int maxTime) 
-        : maxInstances(n), t1(minTime), t2(maxTime), gen(rd()) {
-        instances.reserve(maxInstances); 
-        for (int i = 0; i < maxInstances; ++i) {
-            instances.emplace_back(i + 1);
+    static void report(const Config& config, const std::vector<Result>& results) {
+        std::vector<double> fairness, completion; 
+        int minParties = std::numeric_limits<int>::max(), maxParties = 0; 
+        double parties = 0.0; 
+        for (const Result& result : results) {
+            fairness.push_back(result.fairness * 100.0); 
+            completion.push_back(result.completionSeconds); 
+            minParties = std::min(minParties, result.parties); 
+            maxParties = std::max(maxParties, result.parties); 
+            parties += result.parties;
         }
-    } 
+        std::sort(fairness.begin(), fairness.end()); 
+        std::sort(completion.begin(), completion.end()); 
+        auto mean = [](const std::vector<double>& values) {
+            return std::accumulate(values.begin(), values.end(), 0.0) / std::max<size_t>(values.size(), 1);
+        };
 
-    ~LFGSystem() {
-        stop();
-    } 
+        std::cout << config.name << " (n=" << config.instances << ", " << config.tanks << "/" << config.healers << "/" 
+                  << config.dps << ", " << config.minTime << "-" << config.maxTime << "s), " << results.size() << " runs\n" 
+                  << std::fixed << std::setprecision(1) 
+                  << "  Parties formed: mean " << parties / std::max<size_t>(results.size(), 1) << ", min " << minParties 
+                  << ", max " << maxParties << "\n" 
+                  << "  Fairness:       mean " << mean(fairness) << "%, p5 " << quantile(fairness, 0.05) << "%, p50 " 
+                  << quantile(fairness, 0.5) << "%, p95 " << quantile(fairness, 0.95) << "%\n" 
+                  << "  Completion:     mean " << mean(completion) << "s, p5 " << quantile(completion, 0.05) << "s, p50 " 
+                  << quantile(completion, 0.5) << "s, p95 " << quantile(completion, 0.95) << "s\n";
+    }
 
-    // Add players to queues 
-    void addPlayers(int tanks, int healers, int dps) {
-        std::lock_guard<std::mutex> lock(mtx); 
+    static int run(std::vector<Config> configs, int runs, uint64_t seed) {
+        if (runs < 1) {
+            std::cerr << "Batch needs at least one run\n"; 
+            return 1;
+        }
+        for (const Config& config : configs) {
+            if (config.instances < 1 || config.tanks < 0 || config.healers < 0 || config.dps < 0 || 
+                config.minTime < 0 || config.maxTime < config.minTime) {
+                std::cerr << "Invalid batch configuration: " << config.name << "\n"; 
+                return 1;
+            }
+        }
 
-        for (int i = 0; i < tanks; ++i) {
-            tankQueue.push(1);
-        } 
+        // One task per (configuration, run); workers claim task indices until none are left 
+        size_t tasks = configs.size() * static_cast<size_t>(runs); 
+        std::vector<Result> results(tasks); 
+        std::atomic<size_t> nextTask{0}; 
+        unsigned workers = std::max(1u, std::thread::hardware_concurrency()); 
+        std::cout << "=== Batch: " << tasks << " simulations on " << workers << " threads (seed " << seed << ") ===\n"; 
 
-        for (int i = 0; i < healers; ++i) {
-            healerQueue.push(1); 
-        } 
+        auto begin = std::chrono::steady_clock::now(); 
+        std::vector<std::thread> pool; 
+        for (unsigned w = 0; w < workers; ++w) {
+            pool.emplace_back([&]() {
+                for (size_t task; (task = nextTask.fetch_add(1, std::memory_order_relaxed)) < tasks;) {
+                    // Every run gets its own stream, derived from the seed and the task index 
+                    results[task] = simulate(configs[task / runs], mixSeed(seed + task * 0x9E3779B97F4A7C15ull));
+                }
+            });
+        }
+        for (auto& thread : pool) {
+            thread.join();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); 
 
-        for (int i = 0; i < dps; ++i) {
-            dpsQueue.push(1); 
+        for (size_t c = 0; c < configs.size(); ++c) {
+            report(configs[c], std::vector<Result>(results.begin() + c * runs, results.begin() + (c + 1) * runs));
         }
+        std::cout << "Finished in " << std::fixed << std::setprecision(3) << elapsed << "s (" << std::setprecision(0) 
+                  << tasks / std::max(elapsed, 1e-9) << " simulations/s)\n"; 
+        return 0;
+    }
+};
 
-        std::ostringstream oss;
-        oss << "Added " << tanks << " tanks, " << healers << " healers, " << dps << " DPS to queue."; 
-        synchronized_print(oss.str());
-        cv.notify_all();
+// Correctness checks (run with --selftest); exits non-zero if any fails. Each check builds its 
+// own small system and drives it directly, without instance threads where it can. 
+struct LFGSelfTest {
+    static inline int failures = 0;
+
+    static void check(bool ok, const char* what) {
+        std::cout << (ok ? "ok      " : "FAILED  ") << what << "\n"; 
+        failures += ok ? 0 : 1;
     }
 
-    // Check if party can be formed 
-    bool canFormParty() { 
-        return tankQueue.size() >= 1 && healerQueue.size() >= 1 && dpsQueue.size() >= 3;
-    } 
+    // Logging off and one instance counted as waiting, so tryFormParty forms a party at once 
+    // from the calling thread instead of waiting for an instance thread 
+    static void matcherOnly(LFGSystem& system) {
+        system.setLogging(false); 
+        system.instancesWaiting = 1;
+    }
 
-    // Improved party formation with better distribution 
-    bool tryFormParty(int instanceID) {
-        std::unique_lock<std::mutex> lock(mtx); 
+    // Each template claims exactly its slots, and an instance only forms parties of its own template 
+    static void templateClaims() {
+        bool exact = true; 
+        for (const PartyTemplate* party : {&DungeonParty, &SmallDungeonParty, &RaidParty}) {
+            LFGSystem system(1, 0, 0, *party); 
+            matcherOnly(system); 
+            system.addPlayers(party->slots[Tank] + 1, party->slots[Healer] + 2, party->slots[DPS] + 3); 
+            int tanks, healers, dps; 
+            bool formed = system.tryFormParty(0); 
+            system.getRemainingPlayers(tanks, healers, dps); 
+            exact = exact && formed && tanks == 1 && healers == 2 && dps == 3;
+        }
+        check(exact, "each template claims exactly its slots per role");
 
-        // Use timed wait to prevent instances from starving one another 
-        if (!cv.wait_for(lock, std::chrono::milliseconds(100), 
-                        [this] { return canFormParty() && instancesWaiting > 0; })) {
-            return false;
-        } 
+        LFGSystem mixed(1, 0, 0, RaidParty); 
+        matcherOnly(mixed); 
+        mixed.addInstances(1, SmallDungeonParty); 
+        mixed.addPlayers(1, 1, 2); 
+        bool raidWaits = !mixed.canFormParty(*mixed.instances[0].party); 
+        bool smallForms = mixed.tryFormParty(1); 
+        check(raidWaits && smallForms && mixed.instances[1].active && !mixed.instances[0].active, 
+              "instances of different templates serve the same queues side by side");
+    }
 
-        if (!canFormParty() || !running.load()) {
-            return false;
-        } 
+    // A pre-made group takes its slots as a unit and solo players fill the rest 
+    static void groupWithSolos() {
+        LFGSystem grouped(1, 0, 0); 
+        matcherOnly(grouped); 
+        grouped.addGroup(1, 1, 0); 
+        grouped.addPlayers(0, 0, 3); 
+        bool formed = grouped.tryFormParty(0); 
+        const NoticeRef& notice = grouped.instances[0].notice; 
+        check(formed && notice && notice->groupCount == 1 && notice->playerCount == 3 && grouped.groupsPlaced.load() == 1, 
+              "pre-made group and solo players form one party");
+    }
 
-        // Remove players from queues to form party 
-        tankQueue.pop(); 
-        healerQueue.pop(); 
-        for (int i = 0; i < 3; ++i) {
-            dpsQueue.pop();
-        } 
+    // A flex player whose primary role is already covered takes the role nobody else can fill 
+    static void flexFillsOpenRole() {
+        LFGSystem flexed(1, 0, 0); 
+        matcherOnly(flexed); 
+        int flex = flexed.addFlexPlayers(roleBit(Tank) | roleBit(Healer), 1); 
+        flexed.addPlayers(1, 0, 3); 
+        bool formed = flexed.tryFormParty(0); 
+        check(formed && flexed.players.at(flex)->state.load() == PlayerTable::Matched && flexed.flexPlayersPlaced.load() == 1, 
+              "flex player fills the role the solo queues can't");
+    }
 
-        // Update instance status 
-        instances[instanceID].status = "active"; 
-        instances[instanceID].active = true; 
-        instances[instanceID].partiesServed++; 
-        totalPartiesFormed++; 
+    // A cancelled player is never placed, and a placed one can no longer cancel 
+    static void cancelNeverPlaced() {
+        LFGSystem queued(1, 0, 0); 
+        matcherOnly(queued); 
+        int first = queued.addPlayers(2, 1, 3); 
+        bool cancelled = queued.cancelPlayer(first); 
+        bool formed = queued.tryFormParty(0); 
+        const NoticeRef& notice = queued.instances[0].notice; 
+        bool placed = false; 
+        for (int i = 0; formed && notice && i < notice->playerCount; ++i) {
+            placed |= notice->ids[i] == first;
+        }
+        check(cancelled && formed && !placed && !queued.cancelPlayer(first + 1), 
+              "cancelled player is never placed, a matched one can't cancel");
+    }
 
-        std::ostringstream oss;
-        oss << "Instance " << (instanceID + 1) << " formed a party. "
-                  << "Remaining - Tanks: " << tankQueue.size() 
-                  << ", Healers: " << healerQueue.size() 
-                  << ", DPS: " << dpsQueue.size() << "\n";
-        synchronized_print(oss.str());
-        
-        return true;
+    // A party of pre-made groups only has nobody to answer a ready check and must start anyway 
+    static void allGroupsSkipReadyCheck() {
+        LFGSystem grouped(1, 0, 0); 
+        matcherOnly(grouped); 
+        ReadyCheckPolicy policy; 
+        policy.enabled = true; 
+        grouped.setReadyCheck(policy); 
+        grouped.addGroup(1, 1, 3); 
+        bool started = grouped.tryFormParty(0); 
+        check(started && grouped.instances[0].active && grouped.openReadyChecks == 0, 
+              "all-group party starts without a ready check");
     }
 
-    // Instance thread function with improved synchronzation 
-    void instanceWorker(int instanceId) {
-        while (running.load()) {
-            {
-                std::lock_guard<std::mutex> lock(mtx); 
-                instancesWaiting++; 
-            } 
+    // A declined check sends the whole party, decliner included, back to the queues, and stop() 
+    // does the same for a check nobody has answered yet 
+    static void readyCheckRequeues() {
+        ReadyCheckPolicy policy; 
+        policy.enabled = true; 
+        policy.timeoutMs = 60000; 
+        auto allQueued = [](LFGSystem& system, int first) {
+            bool queued = !system.instances[0].reserved && system.openReadyChecks == 0; 
+            for (int id = first; id < first + 5; ++id) {
+                queued = queued && system.players.at(id)->state.load() == PlayerTable::Queued;
+            }
+            return queued;
+        }; 
 
-            if (tryFormParty(instanceId)) {
-                // Successfully formed a party, run dungeon 
-                runDungeon(instanceId); 
+        LFGSystem declined(1, 0, 0); 
+        matcherOnly(declined); 
+        declined.setReadyCheck(policy); 
+        int first = declined.addPlayers(1, 1, 3); 
+        bool held = !declined.tryFormParty(0) && declined.instances[0].reserved; 
+        declined.respondReadyCheck(first, true); 
+        declined.respondReadyCheck(first + 1, false); 
+        check(held && allQueued(declined, first) && declined.canFormParty(DungeonParty), 
+              "declined ready check requeues every member");
 
-                // Small delay to give other instances a chance 
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            } else {
-                // Couldn't form party, wait before trying 
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
-            } 
+        LFGSystem stopped(1, 0, 0); 
+        matcherOnly(stopped); 
+        stopped.setReadyCheck(policy); 
+        first = stopped.addPlayers(1, 1, 3); 
+        held = !stopped.tryFormParty(0) && stopped.instances[0].reserved; 
+        stopped.stop(); 
+        check(held && allQueued(stopped, first), "stop() requeues players of an open ready check");
+    }
 
-            {
-                std::lock_guard<std::mutex> lock(mtx); 
-                instancesWaiting--;
-            }
+    // Positions count only the player's tier, and cancelled players that must be ahead don't count 
+    static void positionPerTier() {
+        LFGSystem queued(1, 1, 2); 
+        queued.setLogging(false); 
+        int first = queued.addPlayers(0, 0, 10); 
+        int premium = queued.addPlayers(0, 0, 1, Premium); 
+        for (int i = 0; i < 3; ++i) {
+            queued.cancelPlayer(first + i);
         }
+        check(queued.getQueueEstimate(premium).position == 1 && queued.getQueueEstimate(first + 9).position == 7, 
+              "queue position is per tier and skips cancelled players");
     }
 
-    // Simulate dungeon run with random time 
-    void runDungeon(int instanceId) {
-        std::uniform_int_distribution<> dis(t1, t2); 
-        int dungeonTime = dis(gen); 
+    // A bulk enqueue hands out consecutive ids in batch order and skips invalid role masks 
+    static void bulkIds() {
+        LFGSystem bulk(1, 0, 0); 
+        bulk.setLogging(false); 
+        const std::array<PlayerRequest, 4> batch{{{roleBit(DPS)}, {0}, {roleBit(Tank), Premium}, {roleBit(Healer)}}}; 
+        int first = bulk.addPlayers(std::span<const PlayerRequest>(batch)); 
+        const PlayerTable::Record* tank = bulk.players.find(first + 1); 
+        check(bulk.players.at(first)->roleMask == roleBit(DPS) && tank != nullptr && tank->roleMask == roleBit(Tank) && 
+              tank->tier == Premium && bulk.players.at(first + 2)->roleMask == roleBit(Healer) && bulk.players.find(first + 3) == nullptr, 
+              "bulk enqueue ids follow batch order and skip invalid entries");
+    }
 
-        std::ostringstream oss1;
-        oss1 << "Instance " << (instanceId + 1) << " starting dungeon (estimated time: " << dungeonTime << "s)";
-        synchronized_print(oss1.str());
+    // A trace records each instance's party template, so a replay builds the same instances 
+    static void traceTemplates() {
+        const char* tracePath = "lfg_check.lfgt"; 
+        {
+            LFGSystem recorded(1, 0, 0, RaidParty); 
+            recorded.setLogging(false); 
+            recorded.addInstances(2, SmallDungeonParty); 
+            recorded.startTrace(tracePath); 
+            recorded.addPlayers(2, 2, 4);
+        }
+        TraceHeader header; 
+        std::vector<TraceTemplate> templates; 
+        std::vector<TraceRecord> records; 
+        bool truncated = false; 
+        bool loaded = loadTrace(tracePath, header, templates, records, truncated) && !truncated; 
+        auto matches = [&templates](size_t i, const PartyTemplate& party) {
+            return i < templates.size() && std::strcmp(templates[i].name, party.name) == 0 && 
+                   std::equal(party.slots.begin(), party.slots.end(), templates[i].slots);
+        }; 
+        check(loaded && header.instances == 3 && matches(0, RaidParty) && matches(1, SmallDungeonParty) && 
+              matches(2, SmallDungeonParty) && !records.empty() && records[0].type == TraceEnqueue, 
+              "trace header keeps the instance templates");
+        std::remove(tracePath);
+    }
 
-        // Simulate dungeon run time 
-        std::this_thread::sleep_for(std::chrono::seconds(dungeonTime)); 
+    // A failed trace write is reported, a torn last record is flagged, and a replayed cancel 
+    // reaches the player its enqueue got in the replay rather than the recorded id 
+    static void traceIntegrity() {
+        TraceRecorder full("/dev/full", {&DungeonParty}, 0, 0); 
+        if (full.ok()) {
+            full.record(TraceEnqueue, -1, 0, 1, roleBit(Tank)); 
+            check(full.close() == ENOSPC, "failed trace write is reported on close");
+        }
 
-        // Update instance status 
-        std::lock_guard<std::mutex> lock(mtx); 
-        instances[instanceId].status = "empty"; 
-        instances[instanceId].active = false; 
-        instances[instanceId].totalTimeServed += dungeonTime; 
+        const char* tracePath = "lfg_check_torn.lfgt"; 
+        {
+            LFGSystem recorded(1, 0, 0); 
+            recorded.setLogging(false); 
+            recorded.addPlayers(0, 0, 3);   // before recording, so replayed ids start lower 
+            recorded.startTrace(tracePath); 
+            recorded.cancelPlayer(recorded.addPlayers(1, 1, 3));
+        }
+        {
+            std::ofstream torn(tracePath, std::ios::binary | std::ios::app); 
+            torn.write("partial", 7);
+        }
+        TraceHeader header; 
+        std::vector<TraceTemplate> templates; 
+        std::vector<TraceRecord> records; 
+        bool truncated = false; 
+        bool loaded = loadTrace(tracePath, header, templates, records, truncated); 
+        check(loaded && truncated && records.size() == 4, "trace ending in a partial record is flagged");
 
-        std::ostringstream oss2;
-        oss2 << "Instance " << (instanceId + 1) << " completed dungeon in " << dungeonTime << "s"; 
-        synchronized_print(oss2.str());
-        cv.notify_all(); 
+        LFGSystem replayed(1, 0, 0); 
+        replayed.setLogging(false); 
+        LFGReplay::IdRuns runs; 
+        for (const auto& record : records) {
+            LFGReplay::apply(replayed, record, runs);
+        }
+        check(replayed.players.at(0)->state.load() == PlayerTable::Cancelled && 
+              replayed.players.at(3)->state.load() == PlayerTable::Queued, 
+              "replayed cancel maps to the replayed player id");
+        std::remove(tracePath);
     }
 
-    // Start LFG system 
-    void start() {
-        for (int i = 0; i < maxInstances; ++i) {
-            instances[i].thread = std::thread([this, i]() {
-                instanceWorker(i);
-            });
+#ifdef LFG_HAVE_MMAP
+    // The state file keeps totals for every instance a system can hold, and a file of another 
+    // layout is refused rather than recreated 
+    static void stateFileInstances() {
+        const char* statePath = "lfg_check.state"; 
+        std::remove(statePath); 
+        {
+            LFGSystem before(300, 1, 1); 
+            before.setLogging(false); 
+            before.attachState(statePath); 
+            before.stateFile.header()->instanceStats[299].partiesServed = 7;
         }
-    } 
+        bool restored; 
+        {
+            LFGSystem after(300, 1, 1); 
+            after.setLogging(false); 
+            restored = after.attachState(statePath) && after.instances[299].partiesServed == 7;
+        }
+        uint32_t previousVersion = StateVersion - 1; 
+        std::fstream patch(statePath, std::ios::binary | std::ios::in | std::ios::out); 
+        patch.seekp(offsetof(StateHeader, version)); 
+        patch.write(reinterpret_cast<const char*>(&previousVersion), sizeof(previousVersion)); 
+        patch.close(); 
+        LFGSystem older(1, 1, 1); 
+        older.setLogging(false); 
+        bool refused = !older.attachState(statePath); 
+        StateHeader kept{}; 
+        std::ifstream file(statePath, std::ios::binary); 
+        file.read(reinterpret_cast<char*>(&kept), sizeof(kept)); 
+        check(restored && refused && kept.version == StateVersion - 1 && kept.playerCount.load() == 0 && kept.capacity > 0, 
+              "state file covers 1024 instances and refuses other layouts");
+        file.close(); 
+        std::remove(statePath);
+    }
+#endif
 
-    // Stop LFG system 
-    void stop() {
-        running.store(false); 
-        cv.notify_all(); 
+    // A player backfilled into a running instance is logged like any other assignment 
+    static void backfillWal() {
+        const char* walPath = "lfg_check.wal"; 
+        std::remove(walPath); 
+        LFGSystem backfilled(1, 0, 0); 
+        matcherOnly(backfilled); 
+        backfilled.openWal(walPath); 
+        backfilled.addPlayers(1, 1, 3); 
+        backfilled.tryFormParty(0); 
+        int replacement = backfilled.addPlayers(1, 0, 0); 
+        backfilled.requestBackfill(0, Tank); 
+        backfilled.wal->close(); 
+        bool logged = false; 
+        std::ifstream log(walPath, std::ios::binary); 
+        WalEntry entry; 
+        while (log.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+            std::vector<int32_t> ids((entry.length - sizeof(WalEntry)) / sizeof(int32_t)); 
+            log.read(reinterpret_cast<char*>(ids.data()), static_cast<std::streamsize>(ids.size() * sizeof(int32_t))); 
+            logged = logged || (entry.type == WalPlayerBackfilled && entry.instance == 1 && ids.size() == 1 && ids[0] == replacement);
+        }
+        std::remove(walPath); 
+        check(logged, "backfilled player is written to the WAL");
+    }
 
-        for (auto& instance : instances) {
-            if (instance.thread.joinable()) {
-                instance.thread.join();
+#ifdef LFG_HAVE_POSIX_IO
+    // Writes to /dev/full fail with ENOSPC: the entry must not be reported durable 
+    static void walWriteFailure() {
+        for (bool useRing : {false, true}) {
+            WriteAheadLog full; 
+            if (::access("/dev/full", W_OK) != 0 || !full.open("/dev/full", useRing)) {
+                continue;
             }
+            WalEntry entry{}; 
+            entry.length = sizeof(WalEntry); 
+            entry.type = WalDungeonCompleted; 
+            uint64_t lsn = full.append(entry, nullptr); 
+            bool durable = full.waitDurable(lsn); 
+            uint64_t later = full.append(entry, nullptr); 
+            check(!durable && full.error() == ENOSPC && !full.waitDurable(later), 
+                  useRing ? "failed WAL write is not durable (io_uring)" : "failed WAL write is not durable");
         }
     }
+#endif
 
-    // Display current status 
-    void displayStatus() {
-        std::lock_guard<std::mutex> lock(mtx); 
-        
-        synchronized_print("\n=== Current Instance Status ==="); 
-        for (const auto& instance : instances) {
-            std::ostringstream oss; 
-            oss << "Instance " << std::setw(2) << instance.id 
-                << ": " << std::setw(6) << instance.status 
-                << " | Parties served: " << std::setw(3) << instance.partiesServed 
-                << " | Total time: " << std::setw(4) << instance.totalTimeServed 
-                << "s";
-            synchronized_print(oss.str());
-        }
+    // Both export formats report a formed party 
+    static void metricsExport() {
+        LFGSystem measured(1, 0, 0); 
+        matcherOnly(measured); 
+        measured.addPlayers(1, 1, 3); 
+        measured.tryFormParty(0); 
+        std::string text = measured.exportMetrics(false), json = measured.exportMetrics(true); 
+        check(text.find("lfg_players_matched_total 5\n") != std::string::npos && 
+              text.find("lfg_instance_parties_total{instance=\"1\"} 1\n") != std::string::npos && 
+              json.find("\"players_matched\":5,") != std::string::npos, "metrics export counts a formed party");
+    }
 
-        synchronized_print("\n=== Queue Status ==="); 
-        std::ostringstream oss1; 
-        oss1 << "Tanks in queue: " << tankQueue.size(); 
-        synchronized_print(oss1.str()); 
+    // A backfilled player gets a match notice, like players placed by party formation 
+    static void backfillNotice() {
+        LFGSystem backfilled(1, 0, 0); 
+        matcherOnly(backfilled); 
+        std::vector<std::pair<int, int>> matched; 
+        backfilled.setMatchListener([&matched](const NoticeRef& notice) {
+            for (int playerId : notice->players()) {
+                matched.emplace_back(playerId, notice->instanceId);
+            }
+        }); 
+        backfilled.addPlayers(1, 1, 3); 
+        backfilled.tryFormParty(0); 
+        int replacement = backfilled.addPlayers(0, 1, 0); 
+        backfilled.requestBackfill(0, Healer); 
+        check(matched.size() == 6 && matched.back() == std::pair<int, int>(replacement, 0), 
+              "backfilled player is sent a match notice");
+    }
 
-        std::ostringstream oss2; 
-        oss2 << "Healers in queue: " << healerQueue.size(); 
-        synchronized_print(oss2.str()); 
+#ifdef LFG_HAVE_EPOLL
+    // A client that stops reading makes the server queue replies and wait for EPOLLOUT; once the 
+    // client catches up, the server must stop watching for it and go idle 
+    static void backpressureGoesIdle() {
+        const char* path = "./lfg_check_backpressure.sock"; 
+        LFGSystem served(1, 0, 0); 
+        served.setLogging(false); 
+        LFGServer server(served); 
+        int fd = server.start(path, IoBackend::Epoll) ? openStreamSocket(path, false) : -1; 
+        if (fd < 0) {
+            check(false, "server stops watching for EPOLLOUT once a slow client catches up"); 
+            return;
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK); 
+        // 2MB of replies can't all fit in the socket buffers while nothing reads them 
+        std::vector<WireMessage> requests(100000); 
+        for (size_t i = 0; i < requests.size(); ++i) {
+            requests[i].type = WireStatus; 
+            requests[i].requestId = static_cast<uint32_t>(i); 
+            requests[i].playerId = -1;
+        }
+        const char* data = reinterpret_cast<const char*>(requests.data()); 
+        size_t left = requests.size() * sizeof(WireMessage), replies = left; 
+        for (ssize_t written; left > 0 && (written = ::write(fd, data, left)) > 0; data += written, left -= written) {} 
+        std::vector<char> buffer(64 * 1024); 
+        for (ssize_t got; replies > 0 && (got = ::read(fd, buffer.data(), std::min(buffer.size(), replies))) > 0;) {
+            replies -= static_cast<size_t>(got);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50)); 
+        uint64_t before = server.ioSyscalls(); 
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); 
+        uint64_t idleSyscalls = server.ioSyscalls() - before; 
+        ::close(fd); 
+        server.stop(); 
+        check(left == 0 && replies == 0 && idleSyscalls == 0, "server stops watching for EPOLLOUT once a slow client catches up");
+    }
+#endif
 
-        std::ostringstream oss3; 
-        oss3 << "DPS in queue: " << dpsQueue.size(); 
-        synchronized_print(oss3.str()); 
+    // Listeners get the notice the instance holds, not a copy 
+    static void noticeShared() {
+        LFGSystem shared(1, 0, 0); 
+        matcherOnly(shared); 
+        NoticeRef heard; 
+        shared.setMatchListener([&heard](const NoticeRef& notice) {
+            heard = notice;
+        }); 
+        shared.addPlayers(1, 1, 3); 
+        bool formed = shared.tryFormParty(0); 
+        check(formed && heard && &*heard == &*shared.instances[0].notice, "match listener shares the instance's notice");
+    }
 
-        std::ostringstream oss4; 
-        oss4 << "Total parties formed: " << totalPartiesFormed.load(); 
-        synchronized_print(oss4.str()); 
+#ifdef LFG_COUNT_ALLOCATIONS
+    // A warm enqueue-to-completion cycle, with logging on (console output discarded) 
+    static void steadyStateAllocations() {
+        struct NullBuffer : std::streambuf {
+            int overflow(int c) override { return c; }
+            std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+        }; 
+        NullBuffer discard; 
+        const char* timelinePath = "lfg_check_timeline.json"; 
+        const int warmParties = 1000, countedParties = 10000, total = warmParties + countedParties; 
+        const std::array<PlayerRequest, 5> party{{{roleBit(Tank)}, {roleBit(Healer)}, {roleBit(DPS)}, {roleBit(DPS)}, {roleBit(DPS)}}}; 
+        uint64_t counted = 0; 
+        {
+            LFGSystem cycle(1, 0, 0); 
+            cycle.reservePlayers(total * 6); 
+            cycle.instancesWaiting = 1; 
+            // Every player accepts the ready check at once, and a timeline records the run 
+            ReadyCheckPolicy policy; 
+            policy.enabled = true; 
+            policy.simulatedAcceptRate = 1.0; 
+            cycle.setReadyCheck(policy); 
+            cycle.startTimeline(timelinePath); 
+            // A listener holding the last 64 notices, as the network front end does 
+            std::array<NoticeRef, 64> held; 
+            size_t heldNext = 0; 
+            cycle.setMatchListener([&held, &heldNext](const NoticeRef& notice) {
+                held[heldNext++ % held.size()] = notice;
+            }); 
+            std::streambuf* console = std::cout.rdbuf(&discard); 
+            uint64_t before = 0; 
+            for (int i = 0; i < total; ++i) {
+                if (i == warmParties) {
+                    before = threadAllocations;
+                }
+                cycle.addPlayers(std::span<const PlayerRequest>(party)); 
+                if (cycle.tryFormParty(0)) {
+                    // One member leaves and a flex player backfills the slot 
+                    cycle.addFlexPlayers(roleBit(Tank) | roleBit(DPS), 1); 
+                    cycle.requestBackfill(0, DPS); 
+                    cycle.runDungeon(0);
+                }
+            }
+            counted = threadAllocations - before; 
+            std::cout.rdbuf(console); 
+            check(cycle.readyChecksPassed.load() == total && cycle.backfillLatency.count() == static_cast<uint64_t>(total), 
+                  "counted cycle ran a ready check and a backfill per party");
+            cycle.setLogging(false);
+        }
+        std::remove(timelinePath); 
+        check(counted == 0, "a warm cycle with ready checks, backfills and a timeline makes no heap allocations");
+    }
+#endif
 
-        std::ostringstream oss5; 
-        oss5 << "Instances waiting for parties: " << instancesWaiting.load(); 
-        synchronized_print(oss5.str());
+    // A completed party is folded into every stage histogram: once per queue entry (a pair of 
+    // DPS queued as a group counts once) for the queued stages, once per party for the rest 
+    static void stageLatency() {
+        LFGSystem timed(1, 0, 0); 
+        matcherOnly(timed); 
+        timed.addGroup(0, 0, 2); 
+        timed.addPlayers(1, 1, 1); 
+        if (timed.tryFormParty(0)) {
+            timed.runDungeon(0);
+        }
+        check(timed.stageLatency[LFGSystem::StageQueued].count() == 4 && timed.stageLatency[LFGSystem::StageEndToEnd].count() == 4 && 
+              timed.stageLatency[LFGSystem::StageStarting].count() == 1 && timed.stageLatency[LFGSystem::StageRunning].count() == 1, 
+              "party latency is recorded per queue entry and per stage");
     }
 
-    // Wait for all current parties to complete 
-    void waitForCompletion() {
-        bool shouldWait; 
-        do {
-            std::this_thread::sleep_for(std::chrono::seconds(1)); 
+    // stop() runs once, so the destructor's call doesn't write the timeline a second time 
+    static void stopRunsOnce() {
+        const char* timelinePath = "lfg_check_stop.json"; 
+        bool rewritten; 
+        {
+            LFGSystem stopped(1, 0, 0); 
+            stopped.setLogging(false); 
+            stopped.startTimeline(timelinePath); 
+            stopped.start(); 
+            stopped.stop(); 
+            std::remove(timelinePath);
+        }
+        rewritten = std::ifstream(timelinePath).good(); 
+        std::remove(timelinePath); 
+        check(!rewritten, "second stop() leaves the timeline alone");
+    }
 
-            std::lock_guard<std::mutex> lock(mtx); 
-            shouldWait = false; 
+    // The smallest count the planner reports meets the SLO and one fewer doesn't 
+    static void plannerMinimum() {
+        LFGPlanner::Scenario scenario; 
+        scenario.arrivalRate = {1.0, 1.0, 3.0}; 
+        scenario.minTime = 1; 
+        scenario.maxTime = 3; 
+        scenario.parties = 20000; 
+        const double slo = 0.5; 
+        int instances = LFGPlanner::plan(scenario, slo, false); 
+        check(instances > 0 && LFGPlanner::simulate(scenario, instances - 1).instanceWait.percentileMs(99) / 1e3 > slo, 
+              "planner reports the smallest instance count meeting the SLO");
+    }
 
-            // Check if any isntance is active 
-            for (const auto& instance : instances) {
-                if (instance.active) {
-                    shouldWait = true; 
-                    break;
-                }
-            } 
+    // A batch run is a function of its seed, and every formable party is formed 
+    static void batchRepeats() {
+        LFGBatch::Config config{"check", 3, 4, 5, 12, 1, 5}; 
+        LFGBatch::Result first = LFGBatch::simulate(config, 11), second = LFGBatch::simulate(config, 11); 
+        check(first.parties == 4 && first.fairness == second.fairness && first.completionSeconds == second.completionSeconds, 
+              "batch simulation repeats for a seed");
+    }
 
-            // Check if more parties can be formed 
-            if (!shouldWait && canFormParty()) {
-                shouldWait = true;
+    // Two threaded runs with the same seed and input hand out the same parties per instance 
+    static void deterministicRepeats() {
+        auto assignments = []() {
+            LFGSystem seeded(3, 0, 1); 
+            seeded.setLogging(false); 
+            seeded.setDeterministic(7); 
+            seeded.addPlayers(6, 6, 18); 
+            seeded.start(); 
+            seeded.waitForCompletion(); 
+            seeded.stop(); 
+            std::vector<std::pair<int, int>> served; 
+            for (size_t i = 0; i < seeded.instances.size(); ++i) {
+                served.emplace_back(seeded.instances[i].partiesServed, seeded.instances[i].totalTimeServed);
             }
-        } while(shouldWait);
+            return served;
+        }; 
+        auto first = assignments(); 
+        check(first == assignments(), "the same seed gives the same per-instance assignments");
     }
 
-    // Get summary  statistics 
-    void displaySummary() {
-        std::lock_guard<std::mutex> lock(mtx); 
-        synchronized_print("\n=== Final Summary ==="); 
+    // Deterministic turns cover a fixed pool, so the two modes refuse each other in either order 
+    static void deterministicExcludesAutoscale() {
+        AutoscalePolicy policy; 
+        policy.enabled = true; 
+        policy.minInstances = 1; 
+        policy.maxInstances = 4; 
+        LFGSystem seededFirst(2, 0, 0), scaledFirst(2, 0, 0); 
+        bool seeded = seededFirst.setDeterministic(1) && !seededFirst.setAutoscale(policy); 
+        bool scaled = scaledFirst.setAutoscale(policy) && !scaledFirst.setDeterministic(1); 
+        check(seeded && scaled, "deterministic mode and autoscaling are exclusive");
+    }
 
-        int totalParties = 0; 
-        int totalTime = 0; 
-        for (const auto& instance : instances) {
-            std::ostringstream oss; 
-            oss <<  "Instance " << std::setw(2) << instance.id 
-                << ": " << std::setw(3) << instance.partiesServed << " parties, "
-                << std::setw(4) << instance.totalTimeServed << " seconds total"; 
-            synchronized_print(oss.str());
+    // With mixed templates the autoscaler adds the template the queues can fill and retires an 
+    // idle instance of one they can't 
+    static void autoscaleShortTemplate() {
+        LFGSystem mixed(1, 0, 0, RaidParty); 
+        mixed.addInstances(1, SmallDungeonParty); 
+        mixed.setLogging(false); 
+        mixed.start(); 
+        bool chosen, added; 
+        {
+            // Queued and sampled under one lock, so no instance forms a party in between 
+            std::lock_guard<std::mutex> lock(mixed.mtx); 
+            const int counts[RoleCount] = {3, 3, 6}; 
+            for (int r = 0; r < RoleCount; ++r) {
+                mixed.enqueueRun(roleBit(r), Standard, counts[r], LFGSystem::steady_now_ns());
+            }
+            mixed.players.publish(mixed.nextPlayerId); 
+            int live, retire; 
+            const LFGSystem::TemplateDemand* needed = mixed.sampleDemand(live, retire); 
+            chosen = needed != nullptr && needed->party == &SmallDungeonParty && needed->backlog == 3 && live == 2 && retire == 0; 
+            added = mixed.scaleUp(SmallDungeonParty) && mixed.instances[2].party == &SmallDungeonParty;
+        }
+        mixed.stop(); 
+        check(chosen && added, "autoscaler scales the template that is short of instances");
+    }
 
-            totalParties += instance.partiesServed; 
-            totalTime += instance.totalTimeServed;
-        } 
+    // reconfigure rejects out-of-range values and reuses its fixed slots however often it runs 
+    static void reconfigureValidation() {
+        LFGSystem tuned(1, 1, 2); 
+        tuned.setLogging(false); 
+        RuntimeConfig base = tuned.settings(); 
+        auto with = [&base](auto change) {
+            RuntimeConfig next = base; 
+            change(next); 
+            return next;
+        }; 
+        bool rejected = !tuned.reconfigure(with([](RuntimeConfig& c) { c.minTime = 3; c.maxTime = 2; })) && 
+                        !tuned.reconfigure(with([](RuntimeConfig& c) { c.maxTime = RuntimeConfig::MaxClearTimeSeconds + 1; })) && 
+                        !tuned.reconfigure(with([](RuntimeConfig& c) { c.readyCheck.timeoutMs = 0; })) && 
+                        !tuned.reconfigure(with([](RuntimeConfig& c) { c.readyCheck.simulatedAcceptRate = 1.5; })) && 
+                        !tuned.reconfigure(with([](RuntimeConfig& c) { c.backfill.leaveRate = -0.1; })) && 
+                        !tuned.reconfigure(with([](RuntimeConfig& c) { c.backfill.leaveRate = std::nan(""); })); 
+        check(rejected && tuned.settings().maxTime == 2, "reconfigure rejects invalid settings");
+        bool applied = true; 
+        for (int i = 0; i < 100000 && applied; ++i) {
+            applied = tuned.reconfigure(with([i](RuntimeConfig& c) { c.maxTime = 2 + i % 10; }));
+        }
+        check(applied && tuned.settings().maxTime == 2 + 99999 % 10, "100,000 reconfigures reuse the config slots");
+    }
 
-        std::ostringstream oss_total; 
-        oss_total << "System Total: " << totalParties << " parties, " << totalTime << " seconds"; 
-        synchronized_print(oss_total.str());
+    // A drained instance takes no party until it is resumed 
+    static void drainAndResume() {
+        LFGSystem drained(1, 0, 0); 
+        matcherOnly(drained); 
+        drained.addPlayers(1, 1, 3); 
+        bool held = drained.drainInstance(0) && drained.isDrained(0) && !drained.tryFormParty(0); 
+        bool resumed = drained.resumeInstance(0) && drained.tryFormParty(0); 
+        check(held && resumed, "drained instance forms nothing until resumed");
+    }
 
-        // Calculate distribution fairness
-        if (totalParties > 0) {
-            double average = static_cast<double>(totalParties) / instances.size(); 
-            double fairness = 0.0; 
-            
-            for (const auto& instance : instances) {
-                double diff = instance.partiesServed - average; 
-                fairness += diff * diff;
-            } 
-            fairness = 1.0 / (1.0 + std::sqrt(fairness / instances.size())); 
-            
-            std::ostringstream oss_fair;
-            oss_fair << "Distribution fairness: " << std::fixed << std::setprecision(2) << (fairness * 100) << "%"; 
-            synchronized_print(oss_fair.str());
+#ifdef LFG_HAVE_EPOLL
+    // Operator requests work on the admin socket and close a player connection 
+    static void adminSocket() {
+        const char* adminPath = "./lfg_check_admin.sock"; 
+        const char* playerPath = "./lfg_check_player.sock"; 
+        LFGSystem operated(2, 1, 2); 
+        operated.setLogging(false); 
+        LFGAdmin admin(operated); 
+        LFGServer server(operated); 
+        auto exchange = [](const char* path, const WireMessage& request, WireMessage& reply) {
+            int fd = openStreamSocket(path, false); 
+            if (fd < 0) {
+                return false;
+            }
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK); 
+            bool answered = ::write(fd, &request, sizeof(request)) == static_cast<ssize_t>(sizeof(request)) && 
+                            ::read(fd, &reply, sizeof(reply)) == static_cast<ssize_t>(sizeof(reply)); 
+            ::close(fd); 
+            return answered;
+        }; 
+        WireMessage request{}, reply{}; 
+        request.type = WireReconfigure; 
+        request.value = 3; 
+        request.extra = 4; 
+        bool adminApplied = admin.start(adminPath) && exchange(adminPath, request, reply) && 
+                            reply.type == WireReconfigured && reply.flags == 1 && operated.settings().maxTime == 4; 
+        request.extra = 9; 
+        bool playerRefused = server.start(playerPath) && !exchange(playerPath, request, reply) && 
+                             operated.settings().maxTime == 4; 
+        server.stop(); 
+        admin.stop(); 
+        check(adminApplied && playerRefused, "reconfigure is served on the admin socket only");
+    }
+#endif
+
+    // An aborting stop ends a long dungeon at once 
+    static void abortStop() {
+        LFGSystem running(1, 600, 600); 
+        running.setLogging(false); 
+        running.addPlayers(1, 1, 3); 
+        running.start(); 
+        for (int i = 0; i < 200 && running.activeInstances.load() == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
+        auto begin = std::chrono::steady_clock::now(); 
+        running.stop(StopMode::Abort); 
+        auto took = std::chrono::steady_clock::now() - begin; 
+        check(took < std::chrono::seconds(1) && running.dungeonsAborted.load() == 1, "aborting stop ends a running dungeon at once");
     }
 
-    // Get remaining players in queue 
-    void getRemainingPlayers(int& tanks, int& healers, int& dps) {
-        std::lock_guard<std::mutex> lock(mtx); 
-        tanks = tankQueue.size(); 
-        healers = healerQueue.size(); 
-        dps = dpsQueue.size();
+    static int run() {
+        failures = 0; 
+        std::cout << "=== Self-test ===\n"; 
+        templateClaims(); 
+        groupWithSolos(); 
+        flexFillsOpenRole(); 
+        cancelNeverPlaced(); 
+        allGroupsSkipReadyCheck(); 
+        readyCheckRequeues(); 
+        positionPerTier(); 
+        bulkIds(); 
+        traceTemplates(); 
+        traceIntegrity(); 
+#ifdef LFG_HAVE_MMAP
+        stateFileInstances(); 
+#endif
+        backfillWal(); 
+#ifdef LFG_HAVE_POSIX_IO
+        walWriteFailure(); 
+#endif
+        metricsExport(); 
+        backfillNotice(); 
+#ifdef LFG_HAVE_EPOLL
+        backpressureGoesIdle(); 
+#endif
+        noticeShared(); 
+#ifdef LFG_COUNT_ALLOCATIONS
+        steadyStateAllocations(); 
+#else
+        std::cout << "skipped allocation checks (build with -DLFG_COUNT_ALLOCATIONS)\n"; 
+#endif
+        stageLatency(); 
+        stopRunsOnce(); 
+        plannerMinimum(); 
+        batchRepeats(); 
+        deterministicRepeats(); 
+        deterministicExcludesAutoscale(); 
+        autoscaleShortTemplate(); 
+        reconfigureValidation(); 
+        drainAndResume(); 
+#ifdef LFG_HAVE_EPOLL
+        adminSocket(); 
+#endif
+        abortStop(); 
+        std::cout << (failures == 0 ? "All checks passed\n" : std::to_string(failures) + " check(s) failed\n"); 
+        return failures > 0 ? 1 : 0;
     }
 };
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        LFGBenchmark::run(); 
+        return 0;
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--selftest") == 0) {
+        return LFGSelfTest::run();
+    }
+
+    if (argc > 2 && std::strcmp(argv[1], "--replay") == 0) {
+        return LFGReplay::run(argv[2], argc > 3 && std::strcmp(argv[3], "--realtime") == 0);
+    }
+    if (argc > 2 && std::strcmp(argv[1], "--batch") == 0) {
+        std::vector<LFGBatch::Config> configs; 
+        if (argc > 8) {
+            configs.push_back({"Custom", std::atoi(argv[3]), std::atoi(argv[4]), std::atoi(argv[5]), std::atoi(argv[6]), 
+                               std::atoi(argv[7]), std::atoi(argv[8])});
+        } else {
+            // The README test cases, on 5 instances with 1-15s runs 
+            configs = {{"Test Case 1: Even-Steven", 5, 10, 10, 30, 1, 15}, {"Test Case 2: No Healers", 5, 20, 5, 30, 1, 15}, 
+                       {"Test Case 3: No Tanks", 5, 10, 50, 100, 1, 15}, {"Test Case 4: Large-Scale", 5, 200, 200, 1000, 1, 15}};
+        }
+        uint64_t seed = argc > 9 ? std::strtoull(argv[9], nullptr, 10) : 1; 
+        return LFGBatch::run(std::move(configs), std::atoi(argv[2]), seed);
+    }
+    if (argc > 7 && std::strcmp(argv[1], "--plan") == 0) {
+        LFGPlanner::Scenario scenario; 
+        for (int r = 0; r < RoleCount; ++r) {
+            scenario.arrivalRate[r] = std::atof(argv[2 + r]);
+        }
+        scenario.minTime = std::atoi(argv[5]); 
+        scenario.maxTime = std::atoi(argv[6]); 
+        return LFGPlanner::run(scenario, std::atof(argv[7]));
+    }
+#ifdef LFG_HAVE_EPOLL
+    if (argc > 2 && std::strcmp(argv[1], "--loadgen") == 0) {
+        return LFGLoadGen::run(argv[2], argc > 3 ? std::atoi(argv[3]) : 1000, argc > 4 ? std::atoi(argv[4]) : 100, 
+                               argc > 5 ? std::max(1, std::atoi(argv[5])) : 4);
+    }
+#endif
+
+    // Optional features 
+    ReadyCheckPolicy readyCheck; 
+    BackfillPolicy backfill; 
+    std::string tracePath; 
+    std::string timelinePath; 
+    std::string seedArg; 
+    AutoscalePolicy autoscale; 
+    std::string statePath; 
+    std::string walPath; 
+    std::string metricsPath; 
+    std::string serveAddress; 
+    std::string adminPath; 
+    bool uring = false; 
+    bool abortOnStop = false; 
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--ready-check") == 0) {
+            // Simulated players: 90% accept at once, the rest time out after 2s 
+            readyCheck.enabled = true; 
+            readyCheck.timeoutMs = 2000; 
+            readyCheck.simulatedAcceptRate = 0.9;
+        } else if (std::strcmp(argv[i], "--backfill") == 0) {
+            // Simulated departures: 30% of dungeons lose one member mid-run 
+            backfill.leaveRate = 0.3;
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--autoscale") == 0 && i + 2 < argc) {
+            autoscale.enabled = true; 
+            autoscale.minInstances = std::atoi(argv[++i]); 
+            autoscale.maxInstances = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seedArg = argv[++i];
+        } else if (std::strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            timelinePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--state") == 0 && i + 1 < argc) {
+            statePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--wal") == 0 && i + 1 < argc) {
+            walPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (std::strcmp(argv[i], "--admin") == 0 && i + 1 < argc) {
+            adminPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--uring") == 0) {
+            uring = true;
+        } else if (std::strcmp(argv[i], "--abort-on-stop") == 0) {
+            abortOnStop = true;
+        }
+    }
+
     std::cout << "=== LFG (Looking for Group) Dungeon Queuing System ===\n\n"; 
 
     // Get user input 
@@ -370,8 +6931,36 @@ int main() {
 
     // Create and start LFG 
     LFGSystem lfgsystem(n, t1, t2); 
+    lfgsystem.setReadyCheck(readyCheck); 
+    lfgsystem.setBackfill(backfill); 
+    if (!statePath.empty() && !lfgsystem.attachState(statePath)) {
+        std::cerr << "Cannot map state file " << statePath << "\n";
+    }
+    if (!walPath.empty() && !lfgsystem.openWal(walPath, uring)) {
+        std::cerr << "Cannot open WAL " << walPath << "\n";
+    }
+    if (!tracePath.empty() && !lfgsystem.startTrace(tracePath)) {
+        std::cerr << "Cannot create trace file " << tracePath << "\n";
+    }
+    if (!timelinePath.empty()) {
+        lfgsystem.startTimeline(timelinePath);
+    }
+    // Deterministic mode and autoscaling exclude each other; with both flags the seed wins 
+    if (!seedArg.empty()) {
+        if (lfgsystem.setDeterministic(std::strtoull(seedArg.c_str(), nullptr, 10))) {
+            std::cout << "Deterministic mode, seed " << seedArg << "\n";
+        } else {
+            std::cerr << "--seed can't be combined with autoscaling\n";
+        }
+    }
+    if (autoscale.enabled && !lfgsystem.setAutoscale(autoscale)) {
+        std::cerr << "Autoscaling needs 1 <= min <= max and can't be combined with --seed\n";
+    }
     std::cout << "\nStarting LFG system...\n"; 
     lfgsystem.start();
+    if (!metricsPath.empty()) {
+        lfgsystem.startMetricsDump(metricsPath, 1000);
+    }
 
     // Add initial players 
     lfgsystem.addPlayers(t, h, d); 
@@ -379,12 +6968,53 @@ int main() {
     // Display initial status 
     lfgsystem.displayStatus(); 
 
-    // Wait for all parties to complete 
-    std::cout << "\nWaiting for all parties to complete...\n"; 
-    lfgsystem.waitForCompletion(); 
+#ifdef LFG_HAVE_EPOLL
+    // Operator socket for reconfigure and drain requests, open until the system stops 
+    LFGAdmin admin(lfgsystem); 
+    if (!adminPath.empty()) {
+        if (admin.start(adminPath)) {
+            std::cout << "Admin socket on " << adminPath << "\n";
+        } else {
+            std::cerr << "Cannot open admin socket " << adminPath << " (needs a Unix socket path)\n";
+        }
+    }
+
+    // Serve network clients until Enter (or end of input), then drain what they queued 
+    LFGServer server(lfgsystem); 
+    if (!serveAddress.empty()) {
+        if (!server.start(serveAddress, uring ? IoBackend::Uring : IoBackend::Epoll)) {
+            std::cerr << "Cannot listen on " << serveAddress << "\n";
+        } else {
+            std::cout << "\nServing clients on " << serveAddress << " (" 
+                      << (server.ioBackend() == IoBackend::Uring ? "io_uring" : "epoll") << "), press Enter to stop...\n"; 
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); 
+            std::cin.get(); 
+            server.stop(); 
+            std::cout << "Served " << server.requestsServed() << " requests, peak " << server.peakConnections() 
+                      << " connections\n";
+        }
+    }
+#endif
+
+    if (abortOnStop) {
+        // Shut down like a rolling deploy: don't wait out the queues or running dungeons 
+        if (serveAddress.empty()) {
+            std::cout << "\nPress Enter to stop (running dungeons are aborted)...\n"; 
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); 
+            std::cin.get();
+        }
+        auto stopBegin = std::chrono::steady_clock::now(); 
+        lfgsystem.stop(StopMode::Abort); 
+        std::cout << "Stopped in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stopBegin).count() 
+                  << "ms\n";
+    } else {
+        // Wait for all parties to complete 
+        std::cout << "\nWaiting for all parties to complete...\n"; 
+        lfgsystem.waitForCompletion(); 
 
-    // Stop the system 
-    lfgsystem.stop(); 
+        // Stop the system 
+        lfgsystem.stop();
+    }
 
     // Display final status and summary 
     lfgsystem.displayStatus(); 